@@ -0,0 +1,87 @@
+#pragma once
+
+//Bounded lock-free queue from any number of threads to one (Vyukov's ring with a sequence number
+//per cell). Pushing claims a cell by moving the shared tail on with a compare and swap, fills it
+//in and then bumps the cell's sequence number to say it's ready. The one consumer reads cells in
+//order and stops at the first that isn't ready yet, so nothing ever waits on a lock and a push
+//that finds the queue full returns false instead of blocking.
+template <typename T>
+class CommandQueue
+{
+public:
+	//capacity is rounded up to a power of two
+	CommandQueue(std::size_t capacity);
+	CommandQueue(const CommandQueue&) = delete;
+	CommandQueue& operator=(const CommandQueue&) = delete;
+
+	//Any thread. Returns false if the queue is full.
+	bool push(const T& value);
+	//The consumer thread only. Returns false if nothing is ready.
+	bool pop(T& value);
+private:
+	struct Cell
+	{
+		std::atomic<std::size_t> sequence; //index it's ready to be pushed at, or index + 1 once it holds that value
+		T value;
+	};
+
+	std::vector<Cell> m_cells;
+	std::size_t m_mask;
+	alignas(PARTICLE_ALIGNMENT) std::atomic<std::size_t> m_tail{ 0 }; //next index to push at
+	alignas(PARTICLE_ALIGNMENT) std::size_t m_head = 0; //next index to pop, only the consumer touches it
+};
+
+template <typename T>
+CommandQueue<T>::CommandQueue(std::size_t capacity)
+	: m_cells(std::bit_ceil(std::max<std::size_t>(capacity, 2)))
+{
+	m_mask = m_cells.size() - 1;
+	for (std::size_t i = 0; i < m_cells.size(); ++i)
+		m_cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+template <typename T>
+bool CommandQueue<T>::push(const T& value)
+{
+	std::size_t index = m_tail.load(std::memory_order_relaxed);
+	Cell* cell;
+	while (true)
+	{
+		cell = &m_cells[index & m_mask];
+		std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		std::ptrdiff_t difference = (std::ptrdiff_t)sequence - (std::ptrdiff_t)index;
+		if (0 == difference)
+		{
+			//Free for this index, claim it unless another producer got there first
+			if (m_tail.compare_exchange_weak(index, index + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (difference < 0)
+		{
+			return false; //still holds the value from a lap ago, the consumer hasn't got to it
+		}
+		else
+		{
+			index = m_tail.load(std::memory_order_relaxed);
+		}
+	}
+
+	cell->value = value;
+	//Release, the consumer sees the value once it sees the sequence
+	cell->sequence.store(index + 1, std::memory_order_release);
+	return true;
+}
+
+template <typename T>
+bool CommandQueue<T>::pop(T& value)
+{
+	Cell& cell = m_cells[m_head & m_mask];
+	if (cell.sequence.load(std::memory_order_acquire) != m_head + 1)
+		return false;
+
+	value = cell.value;
+	//Ready to be pushed at again one lap on
+	cell.sequence.store(m_head + m_cells.size(), std::memory_order_release);
+	++m_head;
+	return true;
+}
@@ -12,4 +12,58 @@ const double LINE_SCALE_VELOCITY = 0.6;
 //const double SCALE = 57913; //how many meters is in one pixel
 const double GRAV = 2.0; //gravitational constant ( 1000000000002.0 )
 const double RESTITUTION = .8;
-const int BALLS_COUNT = 0;
\ No newline at end of file
+const int BALLS_COUNT = 0;
+const int PHYSICS_RATE = 60; //physics steps per simulated second, independent of FPS
+const int MIN_PHYSICS_RATE = 15;
+const int MAX_PHYSICS_RATE = 960;
+const int MAX_PHYSICS_STEPS_PER_FRAME = 8; //per unit of time warp, a slower machine drops simulated time instead
+const int TIME_WARP_MAX = 4096; //most physics steps run per frame
+const int TIME_WARP_SKIP_PRESENT = 64; //from this time warp up frames aren't rendered at all
+const int TIME_WARP_UNPACED = 64; //from this time warp up the simulation stops keeping to real time and runs flat out
+const double BINARY_MAX_SEMI_MAJOR_AXIS = 150.0; //widest orbit (in pixels) a pair can have to be treated as a binary
+const bool VSYNC = false; //can be toggled at runtime with V
+const int FRAME_PACER_INITIAL_SLEEP_MARGIN = 2; //ms before the frame deadline the pacer stops sleeping and spins
+const int PARTICLE_ALIGNMENT = 64; //bytes, every particle array starts on a cache line
+const int FIXED_FRACTION_BITS = 20; //fixed point physics: 1/2^20 px resolution, positions up to 2^43 px
+const int FRAME_ARENA_SIZE = 1 << 20; //bytes per thread to start with, grows to the largest frame
+const int SPAWN_PARALLEL_CHUNK = 16384; //fewest balls a thread fills in when spawning in bulk
+const int BULK_SPAWN_COUNT = 500; //balls B adds at once
+const int PARTICLE_BUDGET = 100000; //balls allocated for up front
+const double HISTORY_SECONDS = 30.0; //simulated seconds kept for rewinding
+const int HISTORY_RATE = 30; //recorded frames per simulated second
+const int HISTORY_KEYFRAME_INTERVAL = 30; //recorded frames per full keyframe, the most decoded to rewind to one frame
+const double HISTORY_RESOLUTION = 16.0; //recorded positions, velocities and radii are rounded to 1/16
+const int RADIX_SORT_CHUNK = 16384; //keys per chunk when sorting in parallel
+const int REORDER_INTERVAL = 600; //physics steps between reorders along the space-filling curve
+const int REORDER_MIN_INTERVAL = 30; //physics steps between locality checks, and the least between reorders
+const double REORDER_LOCALITY_FACTOR = 2.0; //reorder early when locality gets this much worse than right after a reorder
+const int JOB_QUEUE_SIZE = 4096; //pieces of work each thread can have queued
+const int JOB_PIECES_PER_THREAD = 4; //range tasks are cut into this many pieces per thread, for load balancing
+const int JOB_MIN_BALLS = 4096; //smallest piece of a task that does a little work per ball
+const int JOB_MIN_ROWS = 32; //smallest piece of a task that goes through every other ball for each ball
+const int REDUCTION_BLOCK = 1024; //balls per partial sum in deterministic reductions, fixed so the result doesn't depend on the thread count
+const bool NUMA_AWARE = false; //pin the job threads to processors and give each NUMA node its own share of the balls' memory
+const double NUMA_PLACE_FACTOR = 1.5; //the balls are placed on the nodes again when their number grows or shrinks by this factor
+const int COMMAND_QUEUE_SIZE = 1024; //commands the input can get ahead of the simulation by
+const int ENSEMBLE_RUNS = 256; //runs --ensemble starts when it isn't given a number
+const int ENSEMBLE_CHECK_RUNS = 16; //runs --check-determinism compares when it isn't given a number
+const int ENSEMBLE_BALLS = 500; //balls in each run
+const int ENSEMBLE_STEPS = 3600; //physics steps each run lasts
+const int ENSEMBLE_STEPS_PER_TICK = 10; //steps each run takes between checking which ones have finished
+const int ENSEMBLE_FRAME_ARENA_SIZE = 1 << 16; //bytes each run's arena starts with
+const double ENSEMBLE_GRAV_MIN = 1.0; //the runs spread their gravity over this range
+const double ENSEMBLE_GRAV_MAX = 4.0;
+const double ENSEMBLE_RESTITUTION_MIN = 0.5; //and their restitution over this one
+const double ENSEMBLE_RESTITUTION_MAX = 1.0;
+const int ORBIT_DEMO_DISTANCE = 250; //between the planet and the moon in the orbit scenario
+const int BLACK_HOLE_DEMO_BALLS = 10000; //balls the black hole scenario spawns
+const double BLACK_HOLE_DEMO_DELAY = 5.0; //simulated seconds before the black hole turns up
+const double BLACK_HOLE_RADIUS = 10.0;
+const double BLACK_HOLE_MASS = 1000000.0;
+const int BENCHMARK_BALLS = 2000; //balls the benchmark scenario spawns
+const double BENCHMARK_SECONDS = 10.0; //simulated seconds it times
+const int RENDER_THREADS = 4; //at most, for building the frame's triangles, the simulation has a thread per processor already
+const int RENDER_CHUNK_BALLS = 1024; //balls per batch of triangles, each batch is one draw call
+const double CIRCLE_SEGMENTS_PER_PIXEL = 0.5; //segments a circle gets per pixel of radius
+const int CIRCLE_MIN_SEGMENTS = 8;
+const int CIRCLE_MAX_SEGMENTS = 64;
\ No newline at end of file
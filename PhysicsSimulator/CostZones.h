@@ -0,0 +1,48 @@
+#pragma once
+
+//Each ball's work in the last step, for cutting the next step's range tasks into pieces of
+//equal cost instead of equal length (costzones). A piece is still a run of consecutive balls,
+//which with reordering on is a patch of space along the space-filling curve, so a dense
+//cluster gets split over more threads without scattering anyone's memory. Adding, removing or
+//reordering balls leaves the counts belonging to the wrong indices, until the next step has
+//measured them again pieces are of equal length.
+class CostZones
+{
+public:
+	//Where a step of count balls records each ball's interactions
+	std::uint32_t* measure(std::size_t count);
+	//After the step, the measured counts are what the next step is cut by
+	void measured();
+	void invalidate() { m_valid = false; }
+	//Running totals of the counts, count + 1 of them starting at 0, or nullptr if there are no
+	//counts for count balls
+	const std::uint64_t* getCostPrefix(std::size_t count) const;
+
+	bool enabled = true;
+private:
+	std::vector<std::uint32_t> m_interactions;
+	std::vector<std::uint64_t> m_prefix;
+	bool m_valid = false;
+};
+
+inline std::uint32_t* CostZones::measure(std::size_t count)
+{
+	m_interactions.resize(count);
+	return m_interactions.data();
+}
+
+inline void CostZones::measured()
+{
+	m_prefix.resize(m_interactions.size() + 1);
+	m_prefix[0] = 0;
+	for (std::size_t i = 0; i < m_interactions.size(); ++i)
+		m_prefix[i + 1] = m_prefix[i] + m_interactions[i];
+	m_valid = true;
+}
+
+inline const std::uint64_t* CostZones::getCostPrefix(std::size_t count) const
+{
+	if (!enabled || !m_valid || m_prefix.size() != count + 1 || m_prefix[count] == 0)
+		return nullptr;
+	return m_prefix.data();
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+//Signed fixed point number with FIXED_FRACTION_BITS bits after the point, so the same engine
+//source can be built without floating point in the hot loops. Converts implicitly from
+//double and int (for constants) and explicitly back.
+class Fixed
+{
+public:
+	static constexpr std::int64_t ONE = std::int64_t(1) << FIXED_FRACTION_BITS;
+
+	constexpr Fixed() : m_raw(0) {}
+	constexpr Fixed(int value) : m_raw(std::int64_t(value) * ONE) {}
+	constexpr Fixed(double value) : m_raw(static_cast<std::int64_t>(value * ONE + (value >= 0.0 ? 0.5 : -0.5))) {}
+
+	static constexpr Fixed fromRaw(std::int64_t raw)
+	{
+		Fixed result;
+		result.m_raw = raw;
+		return result;
+	}
+	constexpr std::int64_t raw() const { return m_raw; }
+
+	constexpr explicit operator double() const { return m_raw / (double)ONE; }
+	constexpr explicit operator float() const { return static_cast<float>(m_raw / (double)ONE); }
+	constexpr explicit operator int() const { return static_cast<int>(m_raw / ONE); }
+
+	friend constexpr Fixed operator-(Fixed a) { return fromRaw(-a.m_raw); }
+	friend constexpr Fixed operator+(Fixed a, Fixed b) { return fromRaw(a.m_raw + b.m_raw); }
+	friend constexpr Fixed operator-(Fixed a, Fixed b) { return fromRaw(a.m_raw - b.m_raw); }
+	friend constexpr Fixed operator*(Fixed a, Fixed b) { return fromRaw(multiplyShifted(a.m_raw, b.m_raw)); }
+	//Dividing needs a 128 bit dividend, a double keeps 53 bits of the quotient which is plenty
+	friend constexpr Fixed operator/(Fixed a, Fixed b) { return Fixed(static_cast<double>(a.m_raw) / static_cast<double>(b.m_raw)); }
+
+	constexpr Fixed& operator+=(Fixed other) { m_raw += other.m_raw; return *this; }
+	constexpr Fixed& operator-=(Fixed other) { m_raw -= other.m_raw; return *this; }
+	constexpr Fixed& operator*=(Fixed other) { *this = *this * other; return *this; }
+	constexpr Fixed& operator/=(Fixed other) { *this = *this / other; return *this; }
+
+	friend constexpr bool operator==(const Fixed& a, const Fixed& b) = default;
+	friend constexpr auto operator<=>(const Fixed& a, const Fixed& b) = default;
+
+	friend constexpr Fixed abs(Fixed a) { return a.m_raw < 0 ? -a : a; }
+	friend Fixed sqrt(Fixed a) { return Fixed(std::sqrt(static_cast<double>(a))); }
+	friend Fixed rsqrt(Fixed a) { return Fixed(1.0 / std::sqrt(static_cast<double>(a))); }
+private:
+	//(a * b) >> FIXED_FRACTION_BITS with a 128 bit intermediate, built from 32 bit halves
+	//since MSVC has no 128 bit integer type
+	static constexpr std::int64_t multiplyShifted(std::int64_t a, std::int64_t b)
+	{
+		bool negative = (a < 0) != (b < 0);
+		std::uint64_t ua = a < 0 ? 0 - static_cast<std::uint64_t>(a) : static_cast<std::uint64_t>(a);
+		std::uint64_t ub = b < 0 ? 0 - static_cast<std::uint64_t>(b) : static_cast<std::uint64_t>(b);
+
+		std::uint64_t aLow = ua & 0xffffffff;
+		std::uint64_t aHigh = ua >> 32;
+		std::uint64_t bLow = ub & 0xffffffff;
+		std::uint64_t bHigh = ub >> 32;
+
+		std::uint64_t low = aLow * bLow;
+		std::uint64_t middle1 = aHigh * bLow;
+		std::uint64_t middle2 = aLow * bHigh;
+		std::uint64_t high = aHigh * bHigh;
+
+		std::uint64_t carry = ((low >> 32) + (middle1 & 0xffffffff) + (middle2 & 0xffffffff)) >> 32;
+		std::uint64_t resultLow = low + (middle1 << 32) + (middle2 << 32);
+		std::uint64_t resultHigh = high + (middle1 >> 32) + (middle2 >> 32) + carry;
+
+		std::uint64_t result = (resultHigh << (64 - FIXED_FRACTION_BITS)) | (resultLow >> FIXED_FRACTION_BITS);
+		return negative ? -static_cast<std::int64_t>(result) : static_cast<std::int64_t>(result);
+	}
+
+	std::int64_t m_raw;
+};
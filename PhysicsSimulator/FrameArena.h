@@ -0,0 +1,166 @@
+#pragma once
+
+//Bump allocator for data that only lives until the end of the frame. Allocating is a pointer
+//bump and nothing is freed one by one, reset() drops everything at once. If a frame needs more
+//than the block holds the rest comes from overflow blocks, and the next reset() replaces the
+//block with one big enough for the whole frame, so steady state frames don't touch the heap.
+class alignas(PARTICLE_ALIGNMENT) FrameArena
+{
+public:
+	FrameArena(std::size_t capacity = FRAME_ARENA_SIZE);
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+	FrameArena(FrameArena&& other) noexcept;
+	~FrameArena();
+
+	void* allocate(std::size_t size, std::size_t alignment);
+	template <typename T>
+	T* allocate(std::size_t count) { return static_cast<T*>(allocate(count * sizeof(T), alignof(T))); }
+
+	void reset();
+
+	std::size_t getCapacity() const { return m_capacity; }
+	std::size_t getUsed() const { return m_used + m_overflowUsed; }
+	std::size_t getHighWater() const { return m_highWater; }
+private:
+	static void* allocateBlock(std::size_t size) { return ::operator new(size, std::align_val_t(PARTICLE_ALIGNMENT)); }
+	static void freeBlock(void* block) { ::operator delete(block, std::align_val_t(PARTICLE_ALIGNMENT)); }
+
+	char* m_block;
+	std::size_t m_capacity;
+	std::size_t m_used = 0;
+
+	std::vector<void*> m_overflowBlocks;
+	std::size_t m_overflowUsed = 0; //bytes handed out from overflow blocks
+	std::size_t m_highWater = 0;
+};
+
+inline FrameArena::FrameArena(std::size_t capacity)
+	: m_block(static_cast<char*>(allocateBlock(capacity))), m_capacity(capacity)
+{
+}
+
+inline FrameArena::FrameArena(FrameArena&& other) noexcept
+	: m_block(other.m_block), m_capacity(other.m_capacity), m_used(other.m_used),
+	m_overflowBlocks(std::move(other.m_overflowBlocks)), m_overflowUsed(other.m_overflowUsed), m_highWater(other.m_highWater)
+{
+	other.m_block = nullptr;
+	other.m_capacity = 0;
+	other.m_used = 0;
+	other.m_overflowBlocks.clear();
+	other.m_overflowUsed = 0;
+}
+
+inline FrameArena::~FrameArena()
+{
+	for (void* block : m_overflowBlocks)
+		freeBlock(block);
+	if (m_block)
+		freeBlock(m_block);
+}
+
+inline void* FrameArena::allocate(std::size_t size, std::size_t alignment)
+{
+	std::size_t start = (m_used + alignment - 1) & ~(alignment - 1);
+	if (start + size <= m_capacity)
+	{
+		m_used = start + size;
+		return m_block + start;
+	}
+
+	//Out of room for this frame, reset() will make the block big enough
+	void* block = allocateBlock(size < PARTICLE_ALIGNMENT ? PARTICLE_ALIGNMENT : size);
+	m_overflowBlocks.push_back(block);
+	m_overflowUsed += size;
+	return block;
+}
+
+inline void FrameArena::reset()
+{
+	std::size_t used = getUsed();
+	if (used > m_highWater)
+		m_highWater = used;
+
+	if (!m_overflowBlocks.empty())
+	{
+		for (void* block : m_overflowBlocks)
+			freeBlock(block);
+		m_overflowBlocks.clear();
+
+		//Some headroom so a slowly growing frame doesn't reallocate every time
+		freeBlock(m_block);
+		m_capacity = m_highWater + m_highWater / 2;
+		m_block = static_cast<char*>(allocateBlock(m_capacity));
+	}
+
+	m_used = 0;
+	m_overflowUsed = 0;
+}
+
+//One arena per thread so threads never contend on the bump pointer
+class FrameArenas
+{
+public:
+	FrameArenas(int threadCount);
+
+	FrameArena& get(int thread) { return m_arenas[thread]; }
+	int getThreadCount() const { return (int)m_arenas.size(); }
+
+	void reset();
+	std::size_t getUsed() const;
+	std::size_t getCapacity() const;
+private:
+	std::vector<FrameArena> m_arenas;
+};
+
+inline FrameArenas::FrameArenas(int threadCount)
+{
+	m_arenas.reserve(threadCount);
+	for (int i = 0; i < threadCount; ++i)
+		m_arenas.emplace_back();
+}
+
+inline void FrameArenas::reset()
+{
+	for (FrameArena& arena : m_arenas)
+		arena.reset();
+}
+
+inline std::size_t FrameArenas::getUsed() const
+{
+	std::size_t used = 0;
+	for (const FrameArena& arena : m_arenas)
+		used += arena.getUsed();
+	return used;
+}
+
+inline std::size_t FrameArenas::getCapacity() const
+{
+	std::size_t capacity = 0;
+	for (const FrameArena& arena : m_arenas)
+		capacity += arena.getCapacity();
+	return capacity;
+}
+
+//Standard allocator on top of a FrameArena, for containers that only live for a frame.
+//Deallocating does nothing, the memory comes back when the arena is reset.
+template <typename T>
+struct ArenaAllocator
+{
+	using value_type = T;
+
+	ArenaAllocator(FrameArena& arena) : arena(&arena) {}
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(std::size_t count) { return arena->allocate<T>(count); }
+	void deallocate(T*, std::size_t) {}
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+
+	FrameArena* arena;
+};
+
+template <typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,142 @@
+#pragma once
+
+//Keeps frames on a fixed schedule. SDL_Delay only has millisecond resolution and often
+//oversleeps, so it's used for the bulk of the wait and the rest is spun on the performance counter.
+class FramePacer
+{
+public:
+	FramePacer(int fps);
+
+	void setFps(int fps);
+	void setVsync(SDL_Renderer* renderer, bool vsync);
+	bool getVsync() { return m_vsync; }
+
+	//Waits for the start of the next frame, returns the time since the previous frame started in seconds
+	double waitForNextFrame();
+	//Starts the schedule over from now, for frames that aren't paced at all
+	void resync();
+
+	//Statistics since the last resetStatistics()
+	double getMeanFrameTime() { return m_frameCount > 0 ? m_meanFrameTime : 0.0; }
+	double getJitter() { return m_frameCount > 1 ? std::sqrt(m_frameTimeM2 / (m_frameCount - 1)) : 0.0; }
+	double getWorstFrameTime() { return m_worstFrameTime; }
+	int getLateFrames() { return m_lateFrames; }
+	double getSleepMargin() { return m_sleepMargin / (double)m_ticksPerSecond; }
+	void resetStatistics();
+private:
+	uint64_t m_ticksPerSecond;
+	uint64_t m_ticksPerFrame;
+	uint64_t m_nextFrameTime;
+	uint64_t m_lastFrameTime;
+	uint64_t m_sleepMargin; //how long before the deadline sleeping stops, follows the measured oversleep
+	bool m_vsync;
+
+	int m_frameCount;
+	double m_meanFrameTime;
+	double m_frameTimeM2;
+	double m_worstFrameTime;
+	int m_lateFrames;
+};
+
+inline FramePacer::FramePacer(int fps)
+{
+	m_ticksPerSecond = SDL_GetPerformanceFrequency();
+	m_ticksPerFrame = m_ticksPerSecond / fps;
+	m_sleepMargin = m_ticksPerSecond * FRAME_PACER_INITIAL_SLEEP_MARGIN / 1000;
+	m_vsync = false;
+	m_lastFrameTime = SDL_GetPerformanceCounter();
+	m_nextFrameTime = m_lastFrameTime + m_ticksPerFrame;
+	resetStatistics();
+}
+
+inline void FramePacer::setFps(int fps)
+{
+	m_ticksPerFrame = m_ticksPerSecond / fps;
+	resync();
+}
+
+inline void FramePacer::setVsync(SDL_Renderer* renderer, bool vsync)
+{
+	if (SDL_RenderSetVSync(renderer, vsync ? 1 : 0) != 0)
+	{
+		printf("Couldn't change vsync! SDL Error: %s\n", SDL_GetError());
+		return;
+	}
+	m_vsync = vsync;
+	resync();
+	resetStatistics();
+}
+
+inline double FramePacer::waitForNextFrame()
+{
+	uint64_t now = SDL_GetPerformanceCounter();
+
+	//With vsync SDL_RenderPresent() already waited for the display
+	if (!m_vsync)
+	{
+		if (now > m_nextFrameTime + m_ticksPerFrame)
+		{
+			//More than a frame behind, start the schedule over instead of rushing frames to catch up
+			++m_lateFrames;
+			m_nextFrameTime = now;
+		}
+
+		while (now + m_sleepMargin < m_nextFrameTime)
+		{
+			Uint32 sleepTime = (m_nextFrameTime - m_sleepMargin - now) * 1000 / m_ticksPerSecond;
+			if (sleepTime == 0)
+				break;
+
+			SDL_Delay(sleepTime);
+			uint64_t afterSleep = SDL_GetPerformanceCounter();
+
+			//Grow the margin right away when sleeping overshoots it, shrink it slowly otherwise
+			uint64_t requested = sleepTime * m_ticksPerSecond / 1000;
+			uint64_t oversleep = afterSleep - now > requested ? afterSleep - now - requested : 0;
+			if (oversleep > m_sleepMargin)
+				m_sleepMargin = oversleep;
+			else
+				m_sleepMargin -= (m_sleepMargin - oversleep) / 64;
+
+			now = afterSleep;
+		}
+
+		while (now < m_nextFrameTime)
+		{
+			now = SDL_GetPerformanceCounter();
+		}
+
+		m_nextFrameTime += m_ticksPerFrame;
+	}
+	else
+	{
+		m_nextFrameTime = now + m_ticksPerFrame;
+	}
+
+	double frameTime = (now - m_lastFrameTime) / (double)m_ticksPerSecond;
+	m_lastFrameTime = now;
+
+	//Welford's running mean and variance
+	++m_frameCount;
+	double delta = frameTime - m_meanFrameTime;
+	m_meanFrameTime += delta / m_frameCount;
+	m_frameTimeM2 += delta * (frameTime - m_meanFrameTime);
+	m_worstFrameTime = std::max(m_worstFrameTime, frameTime);
+
+	return frameTime;
+}
+
+inline void FramePacer::resync()
+{
+	m_lastFrameTime = SDL_GetPerformanceCounter();
+	m_nextFrameTime = m_lastFrameTime + m_ticksPerFrame;
+}
+
+inline void FramePacer::resetStatistics()
+{
+	m_frameCount = 0;
+	m_meanFrameTime = 0.0;
+	m_frameTimeM2 = 0.0;
+	m_worstFrameTime = 0.0;
+	m_lateFrames = 0;
+}
@@ -0,0 +1,298 @@
+#pragma once
+
+//Recent states of the balls, for rewinding. Every HISTORY_KEYFRAME_INTERVAL-th frame, and every
+//frame where balls were added, removed or reordered, is a keyframe holding the whole state.
+//The frames in between only hold how far each ball is from where the previous frame said it
+//would be. Everything is rounded to 1/HISTORY_RESOLUTION and written as variable length
+//integers, so a ball moving smoothly costs a few bytes per frame instead of a full copy.
+//Masses are kept exactly, in keyframes only: a frame where one changed is a keyframe too.
+
+//Zigzag variable length integer, small values of either sign take one byte
+inline void writeVarint(std::vector<std::uint8_t>& data, std::int64_t value)
+{
+	std::uint64_t zigzag = ((std::uint64_t)value << 1) ^ (std::uint64_t)(value >> 63);
+	while (zigzag >= 0x80)
+	{
+		data.push_back((std::uint8_t)(zigzag | 0x80));
+		zigzag >>= 7;
+	}
+	data.push_back((std::uint8_t)zigzag);
+}
+
+inline std::int64_t readVarint(const std::uint8_t*& data)
+{
+	std::uint64_t zigzag = 0;
+	int shift = 0;
+	while (*data & 0x80)
+	{
+		zigzag |= (std::uint64_t)(*data++ & 0x7f) << shift;
+		shift += 7;
+	}
+	zigzag |= (std::uint64_t)(*data++) << shift;
+	return (std::int64_t)(zigzag >> 1) ^ -(std::int64_t)(zigzag & 1);
+}
+
+template <typename T>
+class History
+{
+public:
+	History(double seconds);
+
+	//timeStep is the simulated time since the last recorded frame
+	void record(ParticleStore<T>& balls, double timeStep);
+	void clear();
+
+	bool empty() const { return m_recorded == 0; }
+	//Frames are numbered from the first one recorded, only the last seconds' worth are kept
+	std::size_t getOldestFrame();
+	std::size_t getNewestFrame() const { return m_recorded - 1; }
+	double getTimeBetween(std::size_t first, std::size_t last);
+
+	//Puts the balls back the way they were in frame. Balls that didn't exist then are removed,
+	//balls removed since come back with new handles.
+	void restore(std::size_t frame, ParticleStore<T>& balls, JobSystem& jobs, FrameArena& arena);
+	//Forgets everything after frame, for carrying on from a restored state
+	void truncate(std::size_t frame);
+
+	std::size_t getMemoryUsage() const;
+private:
+	//Rounded position, velocity and radius
+	static const int VALUES_PER_BALL = 5;
+
+	struct Frame
+	{
+		bool keyframe = true;
+		double timeStep = 0.0;
+		std::vector<Handle> handles; //keyframes only
+		std::vector<SDL_Color> colors; //keyframes only
+		std::vector<T> masses; //keyframes only
+		std::vector<std::uint8_t> data;
+	};
+
+	Frame& frameAt(std::size_t frame) { return m_frames[frame % m_frames.size()]; }
+	void decode(std::size_t frame);
+
+	static std::int64_t quantise(double value) { return std::llround(value * HISTORY_RESOLUTION); }
+	static std::int64_t predictPosition(std::int64_t position, std::int64_t velocity, double timeStep) { return position + std::llround(velocity * timeStep); }
+
+	std::vector<Frame> m_frames;
+	std::size_t m_recorded = 0;
+	int m_framesSinceKeyframe = 0;
+
+	//The last recorded frame as it will decode, the next frame is encoded against it
+	std::vector<std::int64_t> m_previous;
+	std::vector<Handle> m_previousHandles;
+	std::vector<T> m_previousMasses;
+
+	std::vector<std::int64_t> m_decoded;
+	std::vector<Handle> m_decodedHandles;
+	std::vector<SDL_Color> m_decodedColors;
+	std::vector<T> m_decodedMasses;
+};
+
+template <typename T>
+History<T>::History(double seconds)
+{
+	//Always room for two keyframes, so one is left when the oldest is overwritten
+	std::size_t frames = (std::size_t)(seconds * HISTORY_RATE);
+	m_frames.resize(std::max<std::size_t>(frames, 2 * HISTORY_KEYFRAME_INTERVAL));
+}
+
+template <typename T>
+void History<T>::record(ParticleStore<T>& balls, double timeStep)
+{
+	std::size_t count = balls.size();
+
+	bool keyframe = m_framesSinceKeyframe >= HISTORY_KEYFRAME_INTERVAL || count != m_previousHandles.size();
+	for (std::size_t i = 0; i < count && !keyframe; ++i)
+	{
+		if (!(balls.handles.handleAt(i) == m_previousHandles[i]) || balls.mass[i] != m_previousMasses[i])
+			keyframe = true;
+	}
+
+	Frame& frame = frameAt(m_recorded);
+	frame.keyframe = keyframe;
+	frame.timeStep = timeStep;
+	frame.handles.clear();
+	frame.colors.clear();
+	frame.masses.clear();
+	frame.data.clear();
+
+	if (keyframe)
+	{
+		m_previousHandles.resize(count);
+		m_previousMasses.assign(balls.mass.begin(), balls.mass.end());
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			m_previousHandles[i] = balls.handles.handleAt(i);
+			frame.handles.push_back(m_previousHandles[i]);
+			frame.colors.push_back(balls.coldAt(i).color);
+		}
+		frame.masses.assign(balls.mass.begin(), balls.mass.end());
+		m_framesSinceKeyframe = 0;
+	}
+	m_previous.resize(count * VALUES_PER_BALL);
+
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		std::int64_t* previous = &m_previous[i * VALUES_PER_BALL];
+		std::int64_t values[VALUES_PER_BALL] = {
+			quantise(static_cast<double>(balls.positionX[i])),
+			quantise(static_cast<double>(balls.positionY[i])),
+			quantise(static_cast<double>(balls.velocityX[i])),
+			quantise(static_cast<double>(balls.velocityY[i])),
+			quantise(static_cast<double>(balls.radius[i]))
+		};
+
+		if (keyframe)
+		{
+			for (int j = 0; j < VALUES_PER_BALL; ++j)
+				writeVarint(frame.data, values[j]);
+		}
+		else
+		{
+			writeVarint(frame.data, values[0] - predictPosition(previous[0], previous[2], timeStep));
+			writeVarint(frame.data, values[1] - predictPosition(previous[1], previous[3], timeStep));
+			for (int j = 2; j < VALUES_PER_BALL; ++j)
+				writeVarint(frame.data, values[j] - previous[j]);
+		}
+
+		for (int j = 0; j < VALUES_PER_BALL; ++j)
+			previous[j] = values[j];
+	}
+
+	++m_recorded;
+	++m_framesSinceKeyframe;
+}
+
+template <typename T>
+void History<T>::clear()
+{
+	m_recorded = 0;
+	m_framesSinceKeyframe = 0;
+	m_previousHandles.clear();
+}
+
+template <typename T>
+std::size_t History<T>::getOldestFrame()
+{
+	std::size_t frame = m_recorded > m_frames.size() ? m_recorded - m_frames.size() : 0;
+	//The frames before the first keyframe left can't be decoded any more
+	while (frame < getNewestFrame() && !frameAt(frame).keyframe)
+		++frame;
+	return frame;
+}
+
+template <typename T>
+double History<T>::getTimeBetween(std::size_t first, std::size_t last)
+{
+	double time = 0.0;
+	for (std::size_t frame = first + 1; frame <= last; ++frame)
+		time += frameAt(frame).timeStep;
+	return time;
+}
+
+template <typename T>
+void History<T>::decode(std::size_t frame)
+{
+	std::size_t keyframe = frame;
+	while (!frameAt(keyframe).keyframe)
+		--keyframe;
+
+	const Frame& key = frameAt(keyframe);
+	std::size_t count = key.handles.size();
+	m_decodedHandles.assign(key.handles.begin(), key.handles.end());
+	m_decodedColors.assign(key.colors.begin(), key.colors.end());
+	m_decodedMasses.assign(key.masses.begin(), key.masses.end());
+	m_decoded.resize(count * VALUES_PER_BALL);
+
+	const std::uint8_t* data = key.data.data();
+	for (std::size_t i = 0; i < count * VALUES_PER_BALL; ++i)
+		m_decoded[i] = readVarint(data);
+
+	for (std::size_t delta = keyframe + 1; delta <= frame; ++delta)
+	{
+		const Frame& deltaFrame = frameAt(delta);
+		data = deltaFrame.data.data();
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			std::int64_t* values = &m_decoded[i * VALUES_PER_BALL];
+			values[0] = predictPosition(values[0], values[2], deltaFrame.timeStep) + readVarint(data);
+			values[1] = predictPosition(values[1], values[3], deltaFrame.timeStep) + readVarint(data);
+			for (int j = 2; j < VALUES_PER_BALL; ++j)
+				values[j] += readVarint(data);
+		}
+	}
+}
+
+template <typename T>
+void History<T>::restore(std::size_t frame, ParticleStore<T>& balls, JobSystem& jobs, FrameArena& arena)
+{
+	decode(frame);
+	std::size_t count = m_decodedHandles.size();
+
+	//Only handles valid before anything is added count, a ball added below can get a handle
+	//that was recorded for another ball (e.g. when restoring into a different store)
+	FrameVector<std::uint8_t> existed(balls.handles.slotCount(), 0, arena);
+	for (Handle handle : m_decodedHandles)
+	{
+		if (balls.isValid(handle))
+			existed[handle.slot] = 1;
+	}
+	auto stillExists = [&](Handle handle)
+	{
+		return handle.slot < existed.size() && existed[handle.slot] && balls.isValid(handle);
+	};
+	for (std::size_t i = 0; i < balls.size(); ++i)
+	{
+		if (!existed[balls.handles.handleAt(i).slot])
+			balls.markForRemoval(i);
+	}
+	balls.compact(jobs, arena, stableRemoval);
+
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		const std::int64_t* values = &m_decoded[i * VALUES_PER_BALL];
+		Vector_2d<T> position = vector_cast<T>(Vector_2d<double>{ values[0] / HISTORY_RESOLUTION, values[1] / HISTORY_RESOLUTION });
+		Vector_2d<T> velocity = vector_cast<T>(Vector_2d<double>{ values[2] / HISTORY_RESOLUTION, values[3] / HISTORY_RESOLUTION });
+		T radius = values[4] / HISTORY_RESOLUTION;
+
+		Handle handle = m_decodedHandles[i];
+		if (!stillExists(handle))
+		{
+			Handle added = balls.add(radius, m_decodedColors[i], position, velocity);
+			if (balls.isValid(added))
+				balls.get(added).setMass(m_decodedMasses[i]);
+			continue;
+		}
+
+		PhysicsBall<T> ball = balls.get(handle);
+		ball.setPosition(position);
+		ball.setVelocity(velocity);
+		ball.setRadius(radius);
+		ball.setMass(m_decodedMasses[i]);
+		balls.previousPositionX[ball.getIndex()] = position.x;
+		balls.previousPositionY[ball.getIndex()] = position.y;
+		balls.getCold(handle).color = m_decodedColors[i];
+	}
+}
+
+template <typename T>
+void History<T>::truncate(std::size_t frame)
+{
+	m_recorded = frame + 1;
+	//The encoder's previous state is from a later frame, start again with a keyframe
+	m_previousHandles.clear();
+}
+
+template <typename T>
+std::size_t History<T>::getMemoryUsage() const
+{
+	std::size_t bytes = m_frames.capacity() * sizeof(Frame);
+	for (const Frame& frame : m_frames)
+		bytes += frame.handles.capacity() * sizeof(Handle) + frame.colors.capacity() * sizeof(SDL_Color) + frame.masses.capacity() * sizeof(T) + frame.data.capacity();
+	bytes += (m_previous.capacity() + m_decoded.capacity()) * sizeof(std::int64_t);
+	bytes += (m_previousHandles.capacity() + m_decodedHandles.capacity()) * sizeof(Handle) + m_decodedColors.capacity() * sizeof(SDL_Color);
+	bytes += (m_previousMasses.capacity() + m_decodedMasses.capacity()) * sizeof(T);
+	return bytes;
+}
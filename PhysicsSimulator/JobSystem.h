@@ -0,0 +1,453 @@
+#pragma once
+
+//Work for the JobSystem, built fresh every frame out of the frame arena. A task starts as soon
+//as every task it was added after is done, so independent phases overlap and nothing waits on
+//a barrier. Range tasks are split into pieces that run on all threads at once.
+class TaskGraph
+{
+public:
+	TaskGraph(FrameArena& arena) : m_arena(arena), m_tasks(arena), m_edges(arena) {}
+	TaskGraph(const TaskGraph&) = delete;
+	TaskGraph& operator=(const TaskGraph&) = delete;
+
+	//function() runs once, after every task in after
+	template <typename Function>
+	int add(Function function, std::initializer_list<int> after = {});
+	//function(begin, end) runs on pieces covering [0, count), pieces are at least minChunk long
+	template <typename Function>
+	int addFor(std::size_t count, std::size_t minChunk, Function function, std::initializer_list<int> after = {});
+	//As addFor() but the pieces are cut at equal cost rather than equal length. costPrefix holds
+	//count + 1 running totals of each element's cost starting at 0 (see CostZones), it has to
+	//last until the task has run. Equal length if it's nullptr.
+	template <typename Function>
+	int addWeightedFor(std::size_t count, std::size_t minChunk, const std::uint64_t* costPrefix, Function function, std::initializer_list<int> after = {});
+
+	std::size_t size() const { return m_tasks.size(); }
+private:
+	friend class JobSystem;
+
+	struct Task
+	{
+		void (*invoke)(void* function, std::size_t begin, std::size_t end);
+		void* function;
+		std::size_t count;
+		std::size_t minChunk;
+		const std::uint64_t* costPrefix = nullptr;
+		std::atomic<int> dependencies{ 0 }; //unfinished tasks this one waits for
+		std::atomic<std::size_t> piecesLeft{ 0 };
+		int firstSuccessor = 0;
+		int successorCount = 0;
+		TaskGraph* graph;
+	};
+
+	template <typename Function>
+	int addTask(Function function, void (*invoke)(void*, std::size_t, std::size_t), std::size_t count, std::size_t minChunk, std::initializer_list<int> after);
+
+	FrameArena& m_arena;
+	FrameVector<Task*> m_tasks;
+	FrameVector<std::pair<int, int>> m_edges; //before, after
+	int* m_successors = nullptr;
+	std::atomic<int> m_tasksLeft{ 0 };
+};
+
+//Work-stealing scheduler. Every thread has its own queue and pushes and pops at the back, so it
+//carries on with what it just made while that's still in its cache. A thread with nothing left
+//steals from the front of another thread's queue, which is the oldest and usually biggest work.
+//
+//NUMA-aware, every thread is pinned to a processor and the pieces of a range task go to the
+//queue of the thread whose share of [0, count) they're in, the same share every task, so a
+//thread keeps working on the balls it placed in its node's memory (see ParticleStore::place()).
+//Threads steal from their own node before going to another one.
+class JobSystem
+{
+public:
+	//threadCount includes the thread calling run(), which works too while it waits
+	JobSystem(int threadCount, bool numaAware = false);
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	int getThreadCount() const { return (int)m_queues.size(); }
+	//0 on the thread that calls run(), 1 and up on the workers. For per-thread data like frame arenas.
+	static int getThreadIndex() { return t_threadIndex; }
+
+	//Returns once every task in the graph has run. Can be called from inside a task.
+	void run(TaskGraph& graph);
+	//A graph with a single range task
+	template <typename Function>
+	void parallelFor(std::size_t count, std::size_t minChunk, Function function, FrameArena& arena);
+
+	//Pieces run and pieces taken from another thread's queue since the last call
+	void getStatistics(std::uint64_t& jobs, std::uint64_t& steals);
+
+	bool isNumaAware() const { return m_numaAware; }
+	int getNodeCount() const { return m_topology.getNodeCount(); }
+	//Pins the thread that calls run() along with the workers, call it from that thread
+	void pinCallingThread();
+	//Elements of range tasks a node's threads ran since the last call, and how many of them were
+	//another node's share. Only counted when NUMA-aware.
+	void getNodeTraffic(int node, std::uint64_t& elements, std::uint64_t& remoteElements);
+private:
+	struct Job
+	{
+		TaskGraph::Task* task;
+		std::size_t begin;
+		std::size_t end;
+	};
+
+	//A fixed ring so pushing never allocates. The lock is only contended when stealing.
+	struct alignas(PARTICLE_ALIGNMENT) Queue
+	{
+		std::mutex mutex;
+		std::vector<Job> jobs;
+		std::size_t head = 0; //oldest, where thieves take from
+		std::size_t tail = 0; //newest, where the owner pushes and pops
+	};
+
+	struct alignas(PARTICLE_ALIGNMENT) NodeTraffic
+	{
+		std::atomic<std::uint64_t> elements{ 0 };
+		std::atomic<std::uint64_t> remoteElements{ 0 };
+	};
+
+	void schedule(TaskGraph::Task* task);
+	//Where piece of pieces starts, every chunk elements or at piece / pieces of the total cost
+	static std::size_t getPieceBegin(const TaskGraph::Task* task, std::size_t piece, std::size_t pieces, std::size_t chunk);
+	void finish(TaskGraph::Task* task);
+	//The thread whose share of [0, count) index is in
+	int getHomeThread(std::size_t index, std::size_t count) const { return (int)(index * getThreadCount() / count); }
+	bool push(Job job, int threadIndex);
+	bool pop(Job& job);
+	void execute(Job job);
+	void workerLoop(int threadIndex);
+
+	inline static thread_local int t_threadIndex = 0;
+
+	std::vector<Queue> m_queues;
+	std::vector<std::thread> m_workers;
+
+	bool m_numaAware;
+	NumaTopology m_topology;
+	std::vector<int> m_threadProcessors;
+	std::vector<int> m_threadNodes;
+	std::vector<int> m_stealOrder; //getThreadCount() victims per thread, itself first
+	std::vector<NodeTraffic> m_nodeTraffic;
+
+	std::atomic<int> m_queuedJobs{ 0 };
+	std::atomic<int> m_sleepingWorkers{ 0 };
+	std::atomic<bool> m_quit{ false };
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wake;
+
+	std::atomic<std::uint64_t> m_jobs{ 0 };
+	std::atomic<std::uint64_t> m_steals{ 0 };
+};
+
+template <typename Function>
+int TaskGraph::addTask(Function function, void (*invoke)(void*, std::size_t, std::size_t), std::size_t count, std::size_t minChunk, std::initializer_list<int> after)
+{
+	//The function lives in the arena too, tasks are never destroyed so it has to be trivially destructible
+	static_assert(std::is_trivially_destructible_v<Function>, "Capture by reference");
+	Task* task = new (m_arena.allocate<Task>(1)) Task();
+	task->invoke = invoke;
+	task->function = new (m_arena.allocate<Function>(1)) Function(function);
+	task->count = count;
+	task->minChunk = minChunk ? minChunk : 1;
+	task->graph = this;
+
+	int id = (int)m_tasks.size();
+	m_tasks.push_back(task);
+	for (int before : after)
+		m_edges.push_back(std::pair<int, int>(before, id));
+	return id;
+}
+
+template <typename Function>
+int TaskGraph::add(Function function, std::initializer_list<int> after)
+{
+	return addTask(function, [](void* function, std::size_t, std::size_t) { (*static_cast<Function*>(function))(); }, 1, 1, after);
+}
+
+template <typename Function>
+int TaskGraph::addFor(std::size_t count, std::size_t minChunk, Function function, std::initializer_list<int> after)
+{
+	return addTask(function, [](void* function, std::size_t begin, std::size_t end) { (*static_cast<Function*>(function))(begin, end); }, count, minChunk, after);
+}
+
+template <typename Function>
+int TaskGraph::addWeightedFor(std::size_t count, std::size_t minChunk, const std::uint64_t* costPrefix, Function function, std::initializer_list<int> after)
+{
+	int id = addFor(count, minChunk, function, after);
+	m_tasks[id]->costPrefix = costPrefix;
+	return id;
+}
+
+inline JobSystem::JobSystem(int threadCount, bool numaAware)
+	: m_queues(std::max(threadCount, 1)), m_numaAware(numaAware)
+{
+	for (Queue& queue : m_queues)
+		queue.jobs.resize(JOB_QUEUE_SIZE);
+
+	//Threads go to processors node by node, so each node's threads have consecutive shares
+	if (m_numaAware)
+		m_topology = queryNumaTopology();
+	else
+		m_topology.nodeProcessors.push_back(std::vector<int>());
+	std::vector<int> processors, processorNodes;
+	for (int node = 0; node < getNodeCount(); ++node)
+	{
+		for (int processor : m_topology.nodeProcessors[node])
+		{
+			processors.push_back(processor);
+			processorNodes.push_back(node);
+		}
+	}
+	for (int i = 0; i < getThreadCount(); ++i)
+	{
+		m_threadProcessors.push_back(processors.empty() ? 0 : processors[i % processors.size()]);
+		m_threadNodes.push_back(processorNodes.empty() ? 0 : processorNodes[i % processorNodes.size()]);
+	}
+	m_nodeTraffic = std::vector<NodeTraffic>(getNodeCount());
+
+	//Round from each thread as before, but the threads on its own node first
+	for (int i = 0; i < getThreadCount(); ++i)
+	{
+		for (int sameNode = 1; sameNode >= 0; --sameNode)
+		{
+			for (int j = 0; j < getThreadCount(); ++j)
+			{
+				int victim = (i + j) % getThreadCount();
+				if ((m_threadNodes[victim] == m_threadNodes[i]) == (sameNode != 0))
+					m_stealOrder.push_back(victim);
+			}
+		}
+	}
+	if (m_numaAware)
+		printf("NUMA: %d nodes, %d threads pinned to processors\n", getNodeCount(), getThreadCount());
+
+	m_workers.reserve(m_queues.size() - 1);
+	for (int i = 1; i < (int)m_queues.size(); ++i)
+		m_workers.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+inline JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (std::thread& worker : m_workers)
+		worker.join();
+}
+
+inline void JobSystem::run(TaskGraph& graph)
+{
+	std::size_t taskCount = graph.m_tasks.size();
+	if (taskCount == 0)
+		return;
+
+	//Successor lists, grouped by the task they follow
+	graph.m_successors = graph.m_arena.allocate<int>(graph.m_edges.size() + 1);
+	for (const std::pair<int, int>& edge : graph.m_edges)
+	{
+		++graph.m_tasks[edge.first]->successorCount;
+		++graph.m_tasks[edge.second]->dependencies;
+	}
+	int offset = 0;
+	for (TaskGraph::Task* task : graph.m_tasks)
+	{
+		task->firstSuccessor = offset;
+		offset += task->successorCount;
+		task->successorCount = 0;
+	}
+	for (const std::pair<int, int>& edge : graph.m_edges)
+	{
+		TaskGraph::Task* before = graph.m_tasks[edge.first];
+		graph.m_successors[before->firstSuccessor + before->successorCount++] = edge.second;
+	}
+
+	//Find every task with nothing to wait for before starting any, once one finishes others
+	//can reach zero dependencies too and would be started twice
+	TaskGraph::Task** ready = graph.m_arena.allocate<TaskGraph::Task*>(taskCount);
+	std::size_t readyCount = 0;
+	for (TaskGraph::Task* task : graph.m_tasks)
+	{
+		if (task->dependencies == 0)
+			ready[readyCount++] = task;
+	}
+
+	graph.m_tasksLeft = (int)taskCount;
+	for (std::size_t i = 0; i < readyCount; ++i)
+		schedule(ready[i]);
+
+	//Help instead of waiting
+	while (graph.m_tasksLeft > 0)
+	{
+		Job job;
+		if (pop(job))
+			execute(job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+template <typename Function>
+void JobSystem::parallelFor(std::size_t count, std::size_t minChunk, Function function, FrameArena& arena)
+{
+	TaskGraph graph(arena);
+	graph.addFor(count, minChunk, function);
+	run(graph);
+}
+
+inline void JobSystem::getStatistics(std::uint64_t& jobs, std::uint64_t& steals)
+{
+	jobs = m_jobs.exchange(0);
+	steals = m_steals.exchange(0);
+}
+
+inline void JobSystem::pinCallingThread()
+{
+	if (m_numaAware && !pinThisThread(m_threadProcessors[0]))
+		printf("Warning: Couldn't pin thread 0 to processor %d\n", m_threadProcessors[0]);
+}
+
+inline void JobSystem::getNodeTraffic(int node, std::uint64_t& elements, std::uint64_t& remoteElements)
+{
+	elements = m_nodeTraffic[node].elements.exchange(0);
+	remoteElements = m_nodeTraffic[node].remoteElements.exchange(0);
+}
+
+inline void JobSystem::schedule(TaskGraph::Task* task)
+{
+	if (task->count == 0)
+	{
+		finish(task);
+		return;
+	}
+
+	//A few pieces per thread, so threads that finish early have something to steal
+	std::size_t pieces = (std::size_t)getThreadCount() * JOB_PIECES_PER_THREAD;
+	std::size_t chunk = std::max((task->count + pieces - 1) / pieces, task->minChunk);
+	pieces = (task->count + chunk - 1) / chunk;
+	task->piecesLeft = pieces;
+
+	//Pushed last to first, so this thread's own pops start at the front of the range
+	for (std::size_t piece = pieces; piece-- > 0;)
+	{
+		Job job{ task, getPieceBegin(task, piece, pieces, chunk), getPieceBegin(task, piece + 1, pieces, chunk) };
+		if (!push(job, m_numaAware ? getHomeThread(job.begin, task->count) : t_threadIndex))
+			execute(job);
+	}
+}
+
+inline std::size_t JobSystem::getPieceBegin(const TaskGraph::Task* task, std::size_t piece, std::size_t pieces, std::size_t chunk)
+{
+	if (piece >= pieces)
+		return task->count;
+	if (!task->costPrefix)
+		return piece * chunk;
+
+	//The first element whose cost so far reaches the piece's share, a piece can come out empty
+	//behind an element that costs more than a share on its own
+	const std::uint64_t* prefix = task->costPrefix;
+	std::uint64_t target = prefix[task->count] * piece / pieces;
+	return std::lower_bound(prefix, prefix + task->count, target) - prefix;
+}
+
+inline void JobSystem::finish(TaskGraph::Task* task)
+{
+	TaskGraph& graph = *task->graph;
+	for (int i = 0; i < task->successorCount; ++i)
+	{
+		TaskGraph::Task* successor = graph.m_tasks[graph.m_successors[task->firstSuccessor + i]];
+		if (--successor->dependencies == 0)
+			schedule(successor);
+	}
+	//Last, the graph (and the arena it lives in) can be gone right after this
+	--graph.m_tasksLeft;
+}
+
+inline bool JobSystem::push(Job job, int threadIndex)
+{
+	Queue& queue = m_queues[threadIndex];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tail - queue.head == queue.jobs.size())
+			return false; //full, the caller runs it straight away
+		queue.jobs[queue.tail++ % queue.jobs.size()] = job;
+	}
+	++m_queuedJobs;
+
+	if (m_sleepingWorkers > 0)
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_wake.notify_one();
+	}
+	return true;
+}
+
+inline bool JobSystem::pop(Job& job)
+{
+	int threadCount = getThreadCount();
+	for (int i = 0; i < threadCount; ++i)
+	{
+		int victim = m_stealOrder[t_threadIndex * threadCount + i];
+		Queue& queue = m_queues[victim];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.head == queue.tail)
+			continue;
+
+		if (0 == i)
+		{
+			job = queue.jobs[--queue.tail % queue.jobs.size()];
+		}
+		else
+		{
+			job = queue.jobs[queue.head++ % queue.jobs.size()];
+			++m_steals;
+		}
+		--m_queuedJobs;
+		return true;
+	}
+	return false;
+}
+
+inline void JobSystem::execute(Job job)
+{
+	TaskGraph::Task* task = job.task;
+	task->invoke(task->function, job.begin, job.end);
+	++m_jobs;
+	if (m_numaAware)
+	{
+		int node = m_threadNodes[t_threadIndex];
+		m_nodeTraffic[node].elements += job.end - job.begin;
+		if (m_threadNodes[getHomeThread(job.begin, task->count)] != node)
+			m_nodeTraffic[node].remoteElements += job.end - job.begin;
+	}
+	if (--task->piecesLeft == 0)
+		finish(task);
+}
+
+inline void JobSystem::workerLoop(int threadIndex)
+{
+	t_threadIndex = threadIndex;
+	if (m_numaAware && !pinThisThread(m_threadProcessors[threadIndex]))
+		printf("Warning: Couldn't pin thread %d to processor %d\n", threadIndex, m_threadProcessors[threadIndex]);
+	while (true)
+	{
+		Job job;
+		if (pop(job))
+		{
+			execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		++m_sleepingWorkers;
+		m_wake.wait(lock, [this] { return m_queuedJobs > 0 || m_quit; });
+		--m_sleepingWorkers;
+		if (m_quit)
+			return;
+	}
+}
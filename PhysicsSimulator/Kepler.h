@@ -0,0 +1,118 @@
+#pragma once
+
+//Analytic two-body motion, using the universal variable formulation so it works the same
+//for elliptic, parabolic and hyperbolic orbits (see Danby, Fundamentals of Celestial Mechanics)
+
+const int KEPLER_MAX_ITERATIONS = 64;
+const double KEPLER_TOLERANCE = 1e-13;
+
+//Stumpff functions c0(z)..c3(z)
+inline void stumpff(double z, double& c0, double& c1, double& c2, double& c3)
+{
+	if (z > 0.1)
+	{
+		double sqrtZ = std::sqrt(z);
+		c0 = std::cos(sqrtZ);
+		c1 = std::sin(sqrtZ) / sqrtZ;
+	}
+	else if (z < -0.1)
+	{
+		double sqrtZ = std::sqrt(-z);
+		c0 = std::cosh(sqrtZ);
+		c1 = std::sinh(sqrtZ) / sqrtZ;
+	}
+	else
+	{
+		//Series expansion, the closed forms lose precision near zero
+		c0 = 1.0 - z / 2.0 * (1.0 - z / 12.0 * (1.0 - z / 30.0 * (1.0 - z / 56.0 * (1.0 - z / 90.0))));
+		c1 = 1.0 - z / 6.0 * (1.0 - z / 20.0 * (1.0 - z / 42.0 * (1.0 - z / 72.0 * (1.0 - z / 110.0))));
+		c2 = 0.5 * (1.0 - z / 12.0 * (1.0 - z / 30.0 * (1.0 - z / 56.0 * (1.0 - z / 90.0 * (1.0 - z / 132.0)))));
+		c3 = (1.0 - z / 20.0 * (1.0 - z / 42.0 * (1.0 - z / 72.0 * (1.0 - z / 110.0 * (1.0 - z / 156.0))))) / 6.0;
+		return;
+	}
+
+	c2 = (1.0 - c0) / z;
+	c3 = (1.0 - c1) / z;
+}
+
+//Moves a body along its Kepler orbit around a fixed centre for time dt.
+//position and velocity are relative to the centre, mu is GRAV * (sum of both masses).
+//Returns false (and leaves the state untouched) if the solver didn't converge.
+inline bool keplerDrift(Vector_2d<double>& position, Vector_2d<double>& velocity, double mu, double dt)
+{
+	double r0 = length(position);
+	if (r0 <= 0.0 || mu <= 0.0)
+		return false;
+
+	double eta = dotProduct(position, velocity);
+	double beta = 2.0 * mu / r0 - distanceSquared(velocity); //minus twice the orbital energy
+
+	//Whole revolutions don't change anything, drop them so the solver starts close
+	if (beta > 0.0)
+	{
+		double period = 2.0 * std::_Pi * mu / (beta * std::sqrt(beta));
+		dt = std::fmod(dt, period);
+	}
+
+	//Solve Kepler's equation r0*G1 + eta*G2 + mu*G3 = dt for the universal anomaly s
+	double s = dt / r0;
+	double c0, c1, c2, c3;
+	double r = r0;
+	bool converged = false;
+	for (int i = 0; i < KEPLER_MAX_ITERATIONS; ++i)
+	{
+		stumpff(beta * s * s, c0, c1, c2, c3);
+		double g1 = s * c1;
+		double g2 = s * s * c2;
+		double g3 = s * s * s * c3;
+
+		double time = r0 * g1 + eta * g2 + mu * g3;
+		r = r0 * c0 + eta * g1 + mu * g2; //derivative of time with respect to s
+		double rPrime = eta * c0 + (mu - beta * r0) * g1; //second derivative
+
+		//Halley's method, plain Newton overshoots on very eccentric orbits
+		double error = time - dt;
+		double ds = error / (r - 0.5 * error * rPrime / r);
+		s -= ds;
+
+		if (std::abs(ds) <= KEPLER_TOLERANCE * std::max(std::abs(s), 1e-300))
+		{
+			converged = true;
+			break;
+		}
+	}
+	if (!converged || !(r > 0.0))
+		return false;
+
+	stumpff(beta * s * s, c0, c1, c2, c3);
+	double g1 = s * c1;
+	double g2 = s * s * c2;
+	double g3 = s * s * s * c3;
+	r = r0 * c0 + eta * g1 + mu * g2;
+
+	//Lagrange coefficients
+	double f = 1.0 - mu * g2 / r0;
+	double g = dt - mu * g3;
+	double fDot = -mu * g1 / (r * r0);
+	double gDot = 1.0 - mu * g2 / r;
+
+	Vector_2d<double> newPosition = f * position + g * velocity;
+	velocity = fDot * position + gDot * velocity;
+	position = newPosition;
+
+	return true;
+}
+
+//Other scalars go through double, the solver needs the precision
+template <typename T>
+bool keplerDrift(Vector_2d<T>& position, Vector_2d<T>& velocity, Scalar_t<T> mu, Scalar_t<T> dt)
+{
+	Vector_2d<double> doublePosition = vector_cast<double>(position);
+	Vector_2d<double> doubleVelocity = vector_cast<double>(velocity);
+	if (!keplerDrift(doublePosition, doubleVelocity, static_cast<double>(mu), static_cast<double>(dt)))
+		return false;
+
+	position = vector_cast<T>(doublePosition);
+	velocity = vector_cast<T>(doubleVelocity);
+	return true;
+}
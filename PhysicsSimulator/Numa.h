@@ -0,0 +1,99 @@
+#pragma once
+
+//Which logical processors belong to which NUMA node. On a machine with more than one socket
+//each socket has memory of its own, reaching another socket's memory is slower and shares the
+//link between them. The OS puts a page on the node of the thread that first writes to it.
+struct NumaTopology
+{
+	int getNodeCount() const { return (int)nodeProcessors.size(); }
+
+	std::vector<std::vector<int>> nodeProcessors; //processor numbers for SetThreadGroupAffinity or sched_setaffinity
+};
+
+//Falls back to a single node holding every processor where the OS can't tell
+inline NumaTopology queryNumaTopology()
+{
+	NumaTopology topology;
+
+#if defined(_WIN32)
+	ULONG highestNode = 0;
+	if (GetNumaHighestNodeNumber(&highestNode))
+	{
+		for (ULONG node = 0; node <= highestNode; ++node)
+		{
+			//Processors come in groups of up to 64, the number is group * 64 + bit
+			GROUP_AFFINITY affinity;
+			if (!GetNumaNodeProcessorMaskEx((USHORT)node, &affinity) || 0 == affinity.Mask)
+				continue;
+
+			std::vector<int> processors;
+			for (int bit = 0; bit < 64; ++bit)
+			{
+				if (affinity.Mask & ((KAFFINITY)1 << bit))
+					processors.push_back(affinity.Group * 64 + bit);
+			}
+			topology.nodeProcessors.push_back(processors);
+		}
+	}
+#elif defined(__linux__)
+	for (int node = 0; ; ++node)
+	{
+		char path[64];
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+		FILE* file = fopen(path, "r");
+		if (!file)
+			break;
+
+		//Ranges like 0-3,8-11
+		std::vector<int> processors;
+		int first, last;
+		while (fscanf(file, "%d", &first) == 1)
+		{
+			last = first;
+			int separator = fgetc(file);
+			if ('-' == separator)
+			{
+				if (fscanf(file, "%d", &last) != 1)
+					break;
+				separator = fgetc(file);
+			}
+			for (int processor = first; processor <= last; ++processor)
+				processors.push_back(processor);
+			if (separator != ',')
+				break;
+		}
+		fclose(file);
+
+		if (!processors.empty())
+			topology.nodeProcessors.push_back(processors);
+	}
+#endif
+
+	if (topology.nodeProcessors.empty())
+	{
+		std::vector<int> processors;
+		for (int processor = 0; processor < std::max<int>(std::thread::hardware_concurrency(), 1); ++processor)
+			processors.push_back(processor);
+		topology.nodeProcessors.push_back(processors);
+	}
+	return topology;
+}
+
+//Keeps the calling thread on one processor, so the memory it first touches stays on its node.
+//Returns false where that isn't supported.
+inline bool pinThisThread(int processor)
+{
+#if defined(_WIN32)
+	GROUP_AFFINITY affinity = {};
+	affinity.Group = (WORD)(processor / 64);
+	affinity.Mask = (KAFFINITY)1 << (processor % 64);
+	return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#elif defined(__linux__)
+	cpu_set_t processors;
+	CPU_ZERO(&processors);
+	CPU_SET(processor, &processors);
+	return pthread_setaffinity_np(pthread_self(), sizeof(processors), &processors) == 0;
+#else
+	return false;
+#endif
+}
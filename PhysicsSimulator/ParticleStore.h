@@ -0,0 +1,658 @@
+#pragma once
+
+const int NO_BALL = -1;
+
+//Allocator for the particle arrays, every array starts on a cache line so SIMD loads are aligned
+template <typename T>
+struct AlignedAllocator
+{
+	using value_type = T;
+
+	AlignedAllocator() = default;
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U>&) {}
+
+	T* allocate(std::size_t count)
+	{
+		return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(PARTICLE_ALIGNMENT)));
+	}
+	void deallocate(T* p, std::size_t)
+	{
+		::operator delete(p, std::align_val_t(PARTICLE_ALIGNMENT));
+	}
+
+	//Leaves new elements uninitialised like new T does, so resize() doesn't write to the memory
+	//and the thread that fills it in decides which NUMA node its pages go on. Whoever grows an
+	//array with resize() has to write every new element itself.
+	template <typename U>
+	void construct(U* p) { ::new (static_cast<void*>(p)) U; }
+	template <typename U, typename... Args>
+	void construct(U* p, Args&&... args) { ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+
+	template <typename U>
+	bool operator==(const AlignedAllocator<U>&) const { return true; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+//Moves the last element into index and drops the last one
+template <typename T>
+void swapRemove(AlignedVector<T>& array, std::size_t index)
+{
+	array[index] = array.back();
+	array.pop_back();
+}
+
+//array[i] = array[order[i]] for every i in order, everything else is dropped
+template <typename T>
+void gather(AlignedVector<T>& array, const FrameVector<std::uint32_t>& order, FrameArena& arena)
+{
+	FrameVector<T> copy(array.begin(), array.end(), arena);
+	array.resize(order.size());
+	for (std::size_t i = 0; i < order.size(); ++i)
+		array[i] = copy[order[i]];
+}
+
+template <typename T>
+T massFromRadius(T radius)
+{
+	static T fourPiOverThree = std::_Pi * 4 / 3.0;
+	return fourPiOverThree * radius * radius * radius;
+}
+
+//Screen position between the last two physics steps
+inline Vector_2d<double> interpolatePosition(Vector_2d<double> previousPosition, Vector_2d<double> position, double interpolation)
+{
+	//Don't sweep across the screen when the ball wrapped around
+	Vector_2d<double> step = position - previousPosition;
+	if (std::abs(step.x) > SCREEN_WIDTH / 2 || std::abs(step.y) > SCREEN_HEIGHT / 2)
+		return position;
+
+	return previousPosition + step * interpolation;
+}
+
+enum removalPolicies
+{
+	swapRemoval, //O(1) per ball, the last ball takes the removed one's place
+	stableRemoval, //one pass over everything, the rest keep their order
+	max_removalPolicies
+};
+
+//What adding balls does once the store holds as many as its budget
+enum budgetPolicies
+{
+	rejectWhenFull, //new balls aren't added, memory never grows past the budget
+	growWhenFull, //the budget doubles, with a warning since every array is reallocated
+	max_budgetPolicies
+};
+
+//Bytes a ParticleStore has allocated, by what they're for
+struct ParticleMemory
+{
+	std::size_t hot; //arrays the physics steps through
+	std::size_t cold; //drawing and UI data, pending removals
+	std::size_t handles;
+};
+
+enum particleFlags
+{
+	flagPickedUp = 1 << 0
+};
+
+//What only drawing and the UI need, kept away from the physics arrays
+struct ColdParticle
+{
+	SDL_Color color;
+	std::uint8_t flags;
+};
+
+//Everything ParticleStore::addMany() needs to know about one new ball
+template <typename T>
+struct BallDescription
+{
+	T radius;
+	SDL_Color color;
+	Vector_2d<T> position;
+	Vector_2d<T> velocity;
+};
+
+//Balls spread uniformly over a rectangle, with random sizes, directions and colours.
+//The same seed gives the same balls however many threads fill them in.
+struct SpawnDistribution
+{
+	Vector_2d<double> min;
+	Vector_2d<double> max;
+	double minRadius;
+	double maxRadius;
+	double maxSpeed;
+	std::uint64_t seed;
+};
+
+//Random bits that only depend on the arguments (splitmix64), so any thread can draw the
+//numbers for any ball without sharing a generator. Up to 8 streams per index.
+inline std::uint64_t hashBits(std::uint64_t seed, std::uint64_t index, std::uint64_t stream)
+{
+	std::uint64_t z = seed + (index * 8 + stream + 1) * 0x9e3779b97f4a7c15;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
+}
+
+//In [0, 1)
+inline double hashRandom(std::uint64_t seed, std::uint64_t index, std::uint64_t stream)
+{
+	return (hashBits(seed, index, stream) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+//The unit vector at turns in [0, 1) of a full turn from the x axis, to within 1e-7. A short
+//polynomial on the nearest quarter turn instead of std::cos and std::sin, which took most of a bulk spawn.
+inline Vector_2d<double> directionAt(double turns)
+{
+	int quarters = (int)(turns * 4.0 + 0.5);
+	double x = (turns * 4.0 - quarters) * (std::_Pi / 2); //within an eighth of a turn either way
+	double x2 = x * x;
+	//Taylor series, multiplied by reciprocals since dividing by a constant isn't turned into that
+	double sine = x * (1.0 - x2 * (1.0 / 6.0) * (1.0 - x2 * (1.0 / 20.0) * (1.0 - x2 * (1.0 / 42.0) * (1.0 - x2 * (1.0 / 72.0)))));
+	double cosine = 1.0 - x2 * 0.5 * (1.0 - x2 * (1.0 / 12.0) * (1.0 - x2 * (1.0 / 30.0) * (1.0 - x2 * (1.0 / 56.0))));
+
+	int quadrant = quarters & 3;
+	if (1 == quadrant)
+		return Vector_2d<double>{ -sine, cosine };
+	if (2 == quadrant)
+		return Vector_2d<double>{ -cosine, -sine };
+	if (3 == quadrant)
+		return Vector_2d<double>{ sine, -cosine };
+	return Vector_2d<double>{ cosine, sine };
+}
+
+template <typename T>
+class PhysicsBall;
+
+//Structure of arrays holding every ball. The hot arrays are the ones the physics steps
+//through, one array per field so kernels only touch what they need, e.g. gravity streams
+//through positions and masses and nothing else. Cold data is indexed by handle slot instead
+//of dense index so removing or reordering balls never moves it.
+//T is the scalar the physics runs in (float, double or Fixed).
+template <typename T>
+struct ParticleStore
+{
+	std::size_t size() const { return positionX.size(); }
+	bool empty() const { return positionX.empty(); }
+	void reserve(std::size_t capacity);
+	void clear();
+
+	//Allocates room for capacity balls up front, after that adding balls doesn't allocate
+	//until the budget runs out and the policy says what happens then. Never below the balls
+	//there already are, those would be over budget from the start.
+	void setBudget(std::size_t capacity, budgetPolicies policy);
+	std::size_t getBudget() const { return budget; }
+	ParticleMemory getMemoryUsage() const;
+
+	//Returns an invalid handle if the budget is full
+	Handle add(T radius, SDL_Color color, Vector_2d<T> position, Vector_2d<T> velocity = Vector_2d<T>());
+	//Adds count balls with one allocation per array, generator(i) describes the i-th new ball.
+	//The generator is called from several of the job threads at once. Returns how many fit in the budget.
+	template <typename Generator>
+	std::size_t addMany(JobSystem& jobs, FrameArena& arena, std::size_t count, Generator generator);
+	std::size_t addMany(JobSystem& jobs, FrameArena& arena, std::size_t count, const SpawnDistribution& distribution);
+	//Swap-remove, the last ball takes the removed ball's index
+	void remove(Handle handle);
+	//Removal that waits for compact(), so indices stay put during a physics step
+	void markForRemoval(Handle handle) { pendingRemovals.push_back(handle); }
+	void markForRemoval(std::size_t index) { pendingRemovals.push_back(handles.handleAt(index)); }
+	//Removes the marked balls and optionally reorders the rest along a space-filling curve
+	void compact(JobSystem& jobs, FrameArena& arena, removalPolicies policy, curves reorder = noCurve);
+	//Moves the hot arrays to fresh memory, copying each range on the thread the job system sends
+	//that range to. With NUMA-aware jobs every node then holds the balls it works on.
+	void place(JobSystem& jobs, FrameArena& arena);
+
+	bool isValid(Handle handle) const { return handles.isValid(handle); }
+	PhysicsBall<T> get(Handle handle);
+	PhysicsBall<T> operator[](std::size_t index);
+	PhysicsBall<T> back();
+
+	ColdParticle& getCold(Handle handle) { return cold[handle.slot]; }
+	ColdParticle& coldAt(std::size_t index) { return cold[handles.handleAt(index).slot]; }
+
+	//Indices change when balls are removed or reordered, anything kept between steps uses handles
+	SlotMap handles;
+
+	AlignedVector<T> positionX;
+	AlignedVector<T> positionY;
+	AlignedVector<T> previousPositionX; //position before the last physics step, for rendering between steps
+	AlignedVector<T> previousPositionY;
+	AlignedVector<T> velocityX;
+	AlignedVector<T> velocityY;
+	AlignedVector<T> radius;
+	AlignedVector<T> mass;
+
+	std::vector<ColdParticle> cold;
+
+	std::vector<Handle> pendingRemovals;
+
+	//The constants these balls move by, per store so runs side by side can differ
+	double gravity = GRAV;
+	double restitution = RESTITUTION;
+
+	std::size_t budget = 0;
+	budgetPolicies budgetPolicy = growWhenFull;
+	bool budgetSet = false; //without one the store just grows like a vector
+private:
+	//How many of count new balls fit, after growing if the policy allows it
+	std::size_t makeRoom(std::size_t count);
+};
+
+//The old per-ball interface as a view of one entry in a ParticleStore, for code that
+//hasn't moved to the store kernels. Only valid while the store isn't resized.
+template <typename T>
+class PhysicsBall
+{
+public:
+	PhysicsBall(ParticleStore<T>& store, std::size_t index) : m_store(&store), m_index(index) {}
+
+	bool checkCollision(const PhysicsBall<T>& otherBall);
+	bool checkCollisionWithPoint(Vector_2d<T> point);
+
+	std::size_t getIndex() { return m_index; }
+	Handle getHandle() { return m_store->handles.handleAt(m_index); }
+	Vector_2d<T> getPosition() { return Vector_2d<T>(m_store->positionX[m_index], m_store->positionY[m_index]); }
+	Vector_2d<T> getPreviousPosition() { return Vector_2d<T>(m_store->previousPositionX[m_index], m_store->previousPositionY[m_index]); }
+	Vector_2d<T> getVelocity() { return Vector_2d<T>(m_store->velocityX[m_index], m_store->velocityY[m_index]); }
+	T getRadius() { return m_store->radius[m_index]; }
+	T getMass() { return m_store->mass[m_index]; }
+	SDL_Color getColor() { return m_store->coldAt(m_index).color; }
+
+	void setPosition(Vector_2d<T> position);
+	void setVelocity(Vector_2d<T> velocity);
+	//Sets the mass to match the radius too, setMass() afterwards for a ball that doesn't
+	void setRadius(T radius);
+	void setMass(T mass);
+private:
+	ParticleStore<T>* m_store;
+	std::size_t m_index;
+};
+
+template <typename T>
+void ParticleStore<T>::reserve(std::size_t capacity)
+{
+	positionX.reserve(capacity);
+	positionY.reserve(capacity);
+	previousPositionX.reserve(capacity);
+	previousPositionY.reserve(capacity);
+	velocityX.reserve(capacity);
+	velocityY.reserve(capacity);
+	radius.reserve(capacity);
+	mass.reserve(capacity);
+	cold.reserve(capacity);
+	handles.reserve(capacity);
+}
+
+template <typename T>
+void ParticleStore<T>::setBudget(std::size_t capacity, budgetPolicies policy)
+{
+	if (capacity < size())
+	{
+		printf("Particle budget of %zu balls is below the %zu there are, using %zu\n", capacity, size(), size());
+		capacity = size();
+	}
+	budget = capacity;
+	budgetPolicy = policy;
+	budgetSet = true;
+	reserve(capacity);
+	pendingRemovals.reserve(capacity);
+}
+
+template <typename T>
+ParticleMemory ParticleStore<T>::getMemoryUsage() const
+{
+	ParticleMemory memory;
+	memory.hot = (positionX.capacity() + positionY.capacity() + previousPositionX.capacity() + previousPositionY.capacity() +
+		velocityX.capacity() + velocityY.capacity() + radius.capacity() + mass.capacity()) * sizeof(T);
+	memory.cold = cold.capacity() * sizeof(ColdParticle) + pendingRemovals.capacity() * sizeof(Handle);
+	memory.handles = handles.getMemoryUsage();
+	return memory;
+}
+
+template <typename T>
+std::size_t ParticleStore<T>::makeRoom(std::size_t count)
+{
+	if (size() + count <= budget)
+		return count;
+	if (rejectWhenFull == budgetPolicy)
+		return size() >= budget ? 0 : budget - size();
+
+	std::size_t newBudget = std::max(size() + count, budget * 2);
+	if (budgetSet)
+		printf("Particle budget of %zu balls exceeded, growing to %zu\n", budget, newBudget);
+	budget = newBudget;
+	reserve(newBudget);
+	pendingRemovals.reserve(newBudget);
+	return count;
+}
+
+template <typename T>
+void ParticleStore<T>::clear()
+{
+	positionX.clear();
+	positionY.clear();
+	previousPositionX.clear();
+	previousPositionY.clear();
+	velocityX.clear();
+	velocityY.clear();
+	radius.clear();
+	mass.clear();
+	cold.clear();
+	pendingRemovals.clear();
+	handles.clear();
+}
+
+template <typename T>
+Handle ParticleStore<T>::add(T ballRadius, SDL_Color ballColor, Vector_2d<T> position, Vector_2d<T> velocity)
+{
+	if (makeRoom(1) == 0)
+		return Handle();
+
+	positionX.push_back(position.x);
+	positionY.push_back(position.y);
+	previousPositionX.push_back(position.x);
+	previousPositionY.push_back(position.y);
+	velocityX.push_back(velocity.x);
+	velocityY.push_back(velocity.y);
+	radius.push_back(ballRadius);
+	mass.push_back(massFromRadius(ballRadius));
+
+	Handle handle = handles.insert();
+	if (handle.slot >= cold.size())
+		cold.resize(handle.slot + 1);
+	cold[handle.slot] = ColdParticle{ ballColor, 0 };
+
+	return handle;
+}
+
+template <typename T>
+template <typename Generator>
+std::size_t ParticleStore<T>::addMany(JobSystem& jobs, FrameArena& arena, std::size_t count, Generator generator)
+{
+	count = makeRoom(count);
+	std::size_t first = size();
+	std::size_t total = first + count;
+
+	positionX.resize(total);
+	positionY.resize(total);
+	previousPositionX.resize(total);
+	previousPositionY.resize(total);
+	velocityX.resize(total);
+	velocityY.resize(total);
+	radius.resize(total);
+	mass.resize(total);
+
+	handles.reserve(total);
+	for (std::size_t i = 0; i < count; ++i)
+		handles.insert();
+	if (cold.size() < handles.slotCount())
+		cold.resize(handles.slotCount());
+
+	//The hot arrays grew uninitialised, this is the only thing that writes the new balls, so it
+	//has to set every array
+	jobs.parallelFor(count, SPAWN_PARALLEL_CHUNK, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			BallDescription<T> ball = generator(i);
+			std::size_t index = first + i;
+
+			positionX[index] = ball.position.x;
+			positionY[index] = ball.position.y;
+			previousPositionX[index] = ball.position.x;
+			previousPositionY[index] = ball.position.y;
+			velocityX[index] = ball.velocity.x;
+			velocityY[index] = ball.velocity.y;
+			radius[index] = ball.radius;
+			mass[index] = massFromRadius(ball.radius);
+			cold[handles.handleAt(index).slot] = ColdParticle{ ball.color, 0 };
+		}
+	}, arena);
+
+	return count;
+}
+
+template <typename T>
+std::size_t ParticleStore<T>::addMany(JobSystem& jobs, FrameArena& arena, std::size_t count, const SpawnDistribution& distribution)
+{
+	return addMany(jobs, arena, count, [&distribution](std::size_t i)
+	{
+		std::uint64_t seed = distribution.seed;
+		double ballRadius = distribution.minRadius + (distribution.maxRadius - distribution.minRadius) * hashRandom(seed, i, 0);
+		double x = distribution.min.x + (distribution.max.x - distribution.min.x) * hashRandom(seed, i, 1);
+		double y = distribution.min.y + (distribution.max.y - distribution.min.y) * hashRandom(seed, i, 2);
+
+		double speed = distribution.maxSpeed * hashRandom(seed, i, 3);
+		Vector_2d<double> direction = directionAt(hashRandom(seed, i, 4));
+		std::uint64_t bits = hashBits(seed, i, 5);
+		SDL_Color ballColor = SDL_Color((Uint8)bits, (Uint8)(bits >> 8), (Uint8)(bits >> 16), 255);
+
+		Vector_2d<double> velocity{ speed * direction.x, speed * direction.y };
+		return BallDescription<T>{ T(ballRadius), ballColor, vector_cast<T>(Vector_2d<double>{ x, y }), vector_cast<T>(velocity) };
+	});
+}
+
+template <typename T>
+void ParticleStore<T>::remove(Handle handle)
+{
+	std::size_t index = handles.erase(handle);
+
+	swapRemove(positionX, index);
+	swapRemove(positionY, index);
+	swapRemove(previousPositionX, index);
+	swapRemove(previousPositionY, index);
+	swapRemove(velocityX, index);
+	swapRemove(velocityY, index);
+	swapRemove(radius, index);
+	swapRemove(mass, index);
+}
+
+template <typename T>
+void ParticleStore<T>::compact(JobSystem& jobs, FrameArena& arena, removalPolicies policy, curves reorder)
+{
+	if (swapRemoval == policy && noCurve == reorder)
+	{
+		for (Handle handle : pendingRemovals)
+		{
+			//Might have been marked twice
+			if (isValid(handle))
+				remove(handle);
+		}
+		pendingRemovals.clear();
+		return;
+	}
+
+	if (pendingRemovals.empty() && noCurve == reorder)
+		return;
+
+	std::size_t count = size();
+	FrameVector<std::uint8_t> removed(count, 0, arena);
+	for (Handle handle : pendingRemovals)
+	{
+		if (isValid(handle))
+			removed[handles.indexOf(handle)] = 1;
+	}
+	pendingRemovals.clear();
+
+	FrameVector<std::uint32_t> order(arena);
+	order.reserve(count);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		if (!removed[i])
+			order.push_back(i);
+	}
+
+	if (noCurve != reorder)
+	{
+		FrameVector<std::uint32_t> keys(count, 0, arena);
+		jobs.parallelFor(order.size(), SPAWN_PARALLEL_CHUNK, [&](std::size_t begin, std::size_t end)
+		{
+			for (std::size_t j = begin; j < end; ++j)
+			{
+				std::uint32_t i = order[j];
+				keys[i] = curveCode(reorder, curveCoordinate(static_cast<double>(positionX[i]), SCREEN_WIDTH), curveCoordinate(static_cast<double>(positionY[i]), SCREEN_HEIGHT));
+			}
+		}, arena);
+
+		//Stable, so ties keep their order and the result doesn't depend on the thread count
+		radixSort(jobs, order, keys, arena);
+	}
+
+	gather(positionX, order, arena);
+	gather(positionY, order, arena);
+	gather(previousPositionX, order, arena);
+	gather(previousPositionY, order, arena);
+	gather(velocityX, order, arena);
+	gather(velocityY, order, arena);
+	gather(radius, order, arena);
+	gather(mass, order, arena);
+	handles.compact(order.data(), order.size());
+}
+
+template <typename T>
+void ParticleStore<T>::place(JobSystem& jobs, FrameArena& arena)
+{
+	AlignedVector<T>* arrays[] = { &positionX, &positionY, &previousPositionX, &previousPositionY, &velocityX, &velocityY, &radius, &mass };
+	const int ARRAY_COUNT = sizeof(arrays) / sizeof(arrays[0]);
+
+	//Allocated but not written yet, pages only go to a node when they're first written
+	AlignedVector<T> placed[ARRAY_COUNT];
+	for (int i = 0; i < ARRAY_COUNT; ++i)
+	{
+		placed[i].reserve(arrays[i]->capacity());
+		placed[i].resize(arrays[i]->size());
+	}
+
+	jobs.parallelFor(size(), JOB_MIN_BALLS, [&](std::size_t begin, std::size_t end)
+	{
+		for (int i = 0; i < ARRAY_COUNT; ++i)
+			std::copy(arrays[i]->begin() + begin, arrays[i]->begin() + end, placed[i].begin() + begin);
+	}, arena);
+
+	for (int i = 0; i < ARRAY_COUNT; ++i)
+		arrays[i]->swap(placed[i]);
+}
+
+template <typename T>
+PhysicsBall<T> ParticleStore<T>::get(Handle handle)
+{
+	return PhysicsBall<T>(*this, handles.indexOf(handle));
+}
+
+template <typename T>
+PhysicsBall<T> ParticleStore<T>::operator[](std::size_t index)
+{
+	return PhysicsBall<T>(*this, index);
+}
+
+template <typename T>
+PhysicsBall<T> ParticleStore<T>::back()
+{
+	return PhysicsBall<T>(*this, size() - 1);
+}
+
+template <typename T>
+bool PhysicsBall<T>::checkCollision(const PhysicsBall<T>& otherBall)
+{
+	const ParticleStore<T>& other = *otherBall.m_store;
+	T radiusSum = other.radius[otherBall.m_index] + m_store->radius[m_index];
+	return distanceSquared(other.positionX[otherBall.m_index], other.positionY[otherBall.m_index], m_store->positionX[m_index], m_store->positionY[m_index]) <= radiusSum * radiusSum;
+}
+
+template <typename T>
+bool PhysicsBall<T>::checkCollisionWithPoint(Vector_2d<T> point)
+{
+	return distanceSquared(point, getPosition()) <= getRadius() * getRadius();
+}
+
+template <typename T>
+void PhysicsBall<T>::setPosition(Vector_2d<T> position)
+{
+	m_store->positionX[m_index] = position.x;
+	m_store->positionY[m_index] = position.y;
+}
+
+template <typename T>
+void PhysicsBall<T>::setVelocity(Vector_2d<T> velocity)
+{
+	m_store->velocityX[m_index] = velocity.x;
+	m_store->velocityY[m_index] = velocity.y;
+}
+
+template <typename T>
+void PhysicsBall<T>::setRadius(T radius)
+{
+	m_store->radius[m_index] = radius;
+	m_store->mass[m_index] = massFromRadius(radius);
+}
+
+template <typename T>
+void PhysicsBall<T>::setMass(T mass)
+{
+	m_store->mass[m_index] = mass;
+}
+
+//Mean screen distance between balls next to each other in memory. Low after a reorder,
+//creeps up as the balls move away from where the curve put them.
+template <typename T>
+double measureLocality(const ParticleStore<T>& balls)
+{
+	std::size_t count = balls.size();
+	if (count < 2)
+		return 0.0;
+
+	double total = 0.0;
+	for (std::size_t i = 1; i < count; ++i)
+	{
+		double dx = static_cast<double>(balls.positionX[i] - balls.positionX[i - 1]);
+		double dy = static_cast<double>(balls.positionY[i] - balls.positionY[i - 1]);
+		total += std::sqrt(dx * dx + dy * dy);
+	}
+	return total / (count - 1);
+}
+
+//When to reorder the balls: every REORDER_INTERVAL steps, or sooner once the locality is
+//REORDER_LOCALITY_FACTOR times worse than right after the last reorder
+struct ReorderSchedule
+{
+	bool enabled = false;
+	curves curve = hilbertCurve;
+	int stepsSinceReorder = 0;
+	double sortedLocality = 0.0;
+	double locality = 0.0;
+
+	//Call once per step, returns the curve to reorder along or noCurve
+	template <typename T>
+	curves update(const ParticleStore<T>& balls);
+	//Call after a reorder
+	template <typename T>
+	void reordered(const ParticleStore<T>& balls);
+};
+
+template <typename T>
+curves ReorderSchedule::update(const ParticleStore<T>& balls)
+{
+	++stepsSinceReorder;
+	if (!enabled)
+		return noCurve;
+	if (stepsSinceReorder >= REORDER_INTERVAL)
+		return curve;
+
+	//Measuring walks every ball, only do it every so often
+	if (stepsSinceReorder % REORDER_MIN_INTERVAL != 0)
+		return noCurve;
+	locality = measureLocality(balls);
+	return locality > sortedLocality * REORDER_LOCALITY_FACTOR ? curve : noCurve;
+}
+
+template <typename T>
+void ReorderSchedule::reordered(const ParticleStore<T>& balls)
+{
+	stepsSinceReorder = 0;
+	sortedLocality = locality = measureLocality(balls);
+}
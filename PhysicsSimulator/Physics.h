@@ -0,0 +1,566 @@
+#pragma once
+
+//Physics kernels working on a whole ParticleStore at once. Anything they need only for the
+//current step comes from the frame arena. The kernels that take begin and end only touch
+//balls in that range, so the JobSystem can run pieces of them at the same time.
+
+//Two overlapping balls, found before any of them are resolved
+struct Contact
+{
+	std::uint32_t first;
+	std::uint32_t second;
+};
+
+//Where the broadphase puts the pairs it finds, a list per job thread. They're cleared for every
+//step but keep their capacity, so once they've grown to the busiest step they don't allocate.
+struct ContactLists
+{
+	ContactLists(int threadCount = 1) : lists(threadCount) {}
+
+	std::vector<std::vector<Contact>> lists;
+};
+
+//Overlapping pairs, a row per ball so pieces found in parallel are still resolved in
+//the same order as checking every pair in one go. A row is where its pairs start in the
+//list of the thread that found them, the lists can still grow while other rows are found.
+struct Contacts
+{
+	Contacts(std::size_t count, ContactLists& contactLists, FrameArena& arena);
+
+	const Contact& get(std::size_t row, std::uint32_t index) const { return lists->lists[rowThreads[row]][rowStarts[row] + index]; }
+
+	ContactLists* lists;
+	FrameVector<std::uint16_t> rowThreads;
+	FrameVector<std::uint32_t> rowStarts;
+	FrameVector<std::uint32_t> rowSizes;
+};
+
+inline Contacts::Contacts(std::size_t count, ContactLists& contactLists, FrameArena& arena)
+	: lists(&contactLists), rowThreads(count, 0, arena), rowStarts(count, 0, arena), rowSizes(count, 0, arena)
+{
+	//A new step, the last one's pairs are done with
+	for (std::vector<Contact>& list : lists->lists)
+		list.clear();
+}
+
+//Gravitational acceleration of every ball, only needed within a step
+template <typename T>
+struct Accelerations
+{
+	Accelerations(std::size_t count, FrameArena& arena) : x(count, T(), arena), y(count, T(), arena) {}
+
+	Vector_2d<T> operator[](std::size_t index) const { return Vector_2d<T>(x[index], y[index]); }
+
+	FrameVector<T> x;
+	FrameVector<T> y;
+};
+
+//Pairs of balls that are each other's strongest attractor and are tightly bound are
+//treated as binaries, their orbit is advanced analytically instead of with Euler steps.
+//Returns each ball's partner, or NO_BALL.
+template <typename T>
+FrameVector<int> findBinaries(ParticleStore<T>& balls, FrameArena& arena)
+{
+	FrameVector<int> binaryPartner(balls.size(), NO_BALL, arena);
+	findStrongestPulls(balls, binaryPartner, 0, balls.size());
+	keepBoundBinaries(balls, binaryPartner);
+	return binaryPartner;
+}
+
+//First half of findBinaries(): every ball's strongest attractor
+template <typename T>
+void findStrongestPulls(ParticleStore<T>& balls, FrameVector<int>& binaryPartner, std::size_t begin, std::size_t end)
+{
+	std::size_t count = balls.size();
+	const T* positionX = balls.positionX.data();
+	const T* positionY = balls.positionY.data();
+	const T* mass = balls.mass.data();
+
+	for (std::size_t i = begin; i < end; ++i)
+	{
+		binaryPartner[i] = NO_BALL;
+		T strongestPull = 0.0;
+		for (std::size_t j = 0; j < count; ++j)
+		{
+			if (j != i)
+			{
+				T pull = mass[j] / distanceSquared(positionX[j], positionY[j], positionX[i], positionY[i]);
+				if (pull > strongestPull)
+				{
+					strongestPull = pull;
+					binaryPartner[i] = j;
+				}
+			}
+		}
+	}
+}
+
+//Second half of findBinaries(): drops the pairs that aren't mutual and bound. Reads other
+//balls' partners while it changes them, so it can't be split.
+template <typename T>
+void keepBoundBinaries(ParticleStore<T>& balls, FrameVector<int>& binaryPartner)
+{
+	using std::sqrt;
+	std::size_t count = balls.size();
+	const T* positionX = balls.positionX.data();
+	const T* positionY = balls.positionY.data();
+	const T* mass = balls.mass.data();
+
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		int partner = binaryPartner[i];
+		if (partner == NO_BALL)
+			continue;
+
+		bool bound = false;
+		if (binaryPartner[partner] == (int)i)
+		{
+			T mu = balls.gravity * (mass[i] + mass[partner]);
+			T separation = sqrt(distanceSquared(positionX[partner], positionY[partner], positionX[i], positionY[i]));
+			T energy = 0.5 * distanceSquared(balls.velocityX[partner], balls.velocityY[partner], balls.velocityX[i], balls.velocityY[i]) - mu / separation;
+			bound = energy < 0.0 && -mu / (2.0 * energy) <= BINARY_MAX_SEMI_MAJOR_AXIS;
+		}
+		if (!bound)
+			binaryPartner[i] = NO_BALL;
+	}
+}
+
+//Gravity between every pair of balls, leaving out binary partners (handled by integrateBinary(),
+//binaryPartner can be nullptr if there are none) and optionally one more ball.
+//Accelerations rather than forces, so integrating doesn't need the ball's own mass.
+template <typename T>
+Accelerations<T> calculateAccelerations(ParticleStore<T>& balls, FrameArena& arena, const int* binaryPartner, int ignoredBall = NO_BALL)
+{
+	Accelerations<T> accelerations(balls.size(), arena);
+	calculateAccelerations(balls, accelerations, binaryPartner, ignoredBall, 0, balls.size());
+	return accelerations;
+}
+
+template <typename T>
+void calculateAccelerations(ParticleStore<T>& balls, Accelerations<T>& accelerations, const int* binaryPartner, int ignoredBall, std::size_t begin, std::size_t end)
+{
+	std::size_t count = balls.size();
+	const T* positionX = balls.positionX.data();
+	const T* positionY = balls.positionY.data();
+	const T* mass = balls.mass.data();
+
+	for (std::size_t i = begin; i < end; ++i)
+	{
+		T accelerationX = 0.0;
+		T accelerationY = 0.0;
+
+		if ((int)i != ignoredBall)
+		{
+			int partner = binaryPartner ? binaryPartner[i] : NO_BALL;
+			for (std::size_t j = 0; j < count; ++j)
+			{
+				if (j == i || (int)j == partner || (int)j == ignoredBall)
+					continue;
+
+				T dx = positionX[j] - positionX[i];
+				T dy = positionY[j] - positionY[i];
+				T distSqr = dx * dx + dy * dy;
+				T accelerationValue = mass[j] / distSqr;
+
+				//Normalize vector and scale by acceleration value
+				T scale = accelerationValue * rsqrt(distSqr);
+				accelerationX += scale * dx;
+				accelerationY += scale * dy;
+			}
+		}
+
+		accelerations.x[i] = balls.gravity * accelerationX;
+		accelerations.y[i] = balls.gravity * accelerationY;
+	}
+}
+
+template <typename T>
+void integrateBinary(ParticleStore<T>& balls, const Accelerations<T>& accelerations, std::size_t first, std::size_t second, Scalar_t<T> elapsedTime)
+{
+	T firstMass = balls.mass[first];
+	T secondMass = balls.mass[second];
+	T totalMass = firstMass + secondMass;
+	PhysicsBall<T> firstBall = balls[first];
+	PhysicsBall<T> secondBall = balls[second];
+
+	//The rest of the balls move the centre of mass, and the difference of their pull perturbs the orbit
+	Vector_2d<T> centreVelocity = (firstMass * firstBall.getVelocity() + secondMass * secondBall.getVelocity()) / totalMass;
+	centreVelocity += (firstMass * accelerations[first] + secondMass * accelerations[second]) / totalMass * elapsedTime;
+	Vector_2d<T> centrePosition = (firstMass * firstBall.getPosition() + secondMass * secondBall.getPosition()) / totalMass;
+	centrePosition += centreVelocity * elapsedTime;
+
+	Vector_2d<T> relativeVelocity = secondBall.getVelocity() - firstBall.getVelocity();
+	relativeVelocity += (accelerations[second] - accelerations[first]) * elapsedTime;
+	Vector_2d<T> relativePosition = secondBall.getPosition() - firstBall.getPosition();
+	if (!keplerDrift(relativePosition, relativeVelocity, balls.gravity * totalMass, elapsedTime))
+	{
+		relativeVelocity -= balls.gravity * totalMass * normalizeVector(relativePosition) / distanceSquared(relativePosition) * elapsedTime;
+		relativePosition += relativeVelocity * elapsedTime;
+	}
+
+	firstBall.setPosition(centrePosition - secondMass / totalMass * relativePosition);
+	secondBall.setPosition(centrePosition + firstMass / totalMass * relativePosition);
+	firstBall.setVelocity(centreVelocity - secondMass / totalMass * relativeVelocity);
+	secondBall.setVelocity(centreVelocity + firstMass / totalMass * relativeVelocity);
+}
+
+template <typename T>
+void integrate(ParticleStore<T>& balls, const Accelerations<T>& accelerations, const int* binaryPartner, Scalar_t<T> elapsedTime)
+{
+	integrate(balls, accelerations, binaryPartner, elapsedTime, 0, balls.size());
+}
+
+//A binary is advanced by its first ball, the second one's piece leaves it alone
+template <typename T>
+void integrate(ParticleStore<T>& balls, const Accelerations<T>& accelerations, const int* binaryPartner, Scalar_t<T> elapsedTime, std::size_t begin, std::size_t end)
+{
+	T* positionX = balls.positionX.data();
+	T* positionY = balls.positionY.data();
+	T* velocityX = balls.velocityX.data();
+	T* velocityY = balls.velocityY.data();
+	const T* accelerationX = accelerations.x.data();
+	const T* accelerationY = accelerations.y.data();
+	const T* mass = balls.mass.data();
+
+	for (std::size_t i = begin; i < end; ++i)
+	{
+		int partner = binaryPartner[i];
+		if (partner != NO_BALL)
+		{
+			//Both balls of a binary are advanced by the first one
+			if ((int)i < partner)
+				integrateBinary(balls, accelerations, i, partner, elapsedTime);
+			continue;
+		}
+
+		if (mass[i] > 0.0)
+		{
+			velocityX[i] += accelerationX[i] * elapsedTime;
+			velocityY[i] += accelerationY[i] * elapsedTime;
+			positionX[i] += velocityX[i] * elapsedTime;
+			positionY[i] += velocityY[i] * elapsedTime;
+		}
+	}
+}
+
+//Wisdom-Holman step in democratic heliocentric coordinates: the heaviest ball is the centre
+//every other ball drifts around analytically, only the pull between the others is integrated
+//with kicks. Lightly perturbed orbits stay accurate with steps many times longer than Euler's.
+//The sums over all balls go through parallelSum(), deterministic gives the same result on any
+//number of threads.
+template <typename T>
+void stepWisdomHolman(ParticleStore<T>& balls, JobSystem& jobs, FrameArena& arena, reductionModes reduction, Scalar_t<T> elapsedTime)
+{
+	if (balls.empty())
+		return;
+
+	std::size_t count = balls.size();
+	T* positionX = balls.positionX.data();
+	T* positionY = balls.positionY.data();
+	T* velocityX = balls.velocityX.data();
+	T* velocityY = balls.velocityY.data();
+	const T* mass = balls.mass.data();
+
+	std::size_t central = std::max_element(balls.mass.begin(), balls.mass.end()) - balls.mass.begin();
+	T centralMass = mass[central];
+	T halfTime = elapsedTime / 2.0;
+
+	//The central ball already handles close encounters, so no binaries in this mode
+	std::array<T, 5> centre = parallelSum<T, 5>(jobs, arena, count, reduction, [&](std::size_t i, std::array<T, 5>& terms)
+	{
+		terms[0] = mass[i];
+		terms[1] = mass[i] * positionX[i];
+		terms[2] = mass[i] * positionY[i];
+		terms[3] = mass[i] * velocityX[i];
+		terms[4] = mass[i] * velocityY[i];
+	});
+	T totalMass = centre[0];
+	Vector_2d<T> centrePosition = Vector_2d<T>(centre[1], centre[2]) / totalMass;
+	Vector_2d<T> centreVelocity = Vector_2d<T>(centre[3], centre[4]) / totalMass;
+
+	//Positions relative to the central ball, velocities relative to the centre of mass
+	Vector_2d<T> centralStart(positionX[central], positionY[central]);
+	jobs.parallelFor(count, JOB_MIN_BALLS, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			if (i != central)
+			{
+				positionX[i] -= centralStart.x;
+				positionY[i] -= centralStart.y;
+				velocityX[i] -= centreVelocity.x;
+				velocityY[i] -= centreVelocity.y;
+			}
+		}
+	}, arena);
+
+	auto kick = [&]()
+	{
+		Accelerations<T> accelerations(count, arena);
+		jobs.parallelFor(count, JOB_MIN_ROWS, [&](std::size_t begin, std::size_t end)
+		{
+			calculateAccelerations(balls, accelerations, nullptr, (int)central, begin, end);
+		}, arena);
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			if (i != central)
+			{
+				velocityX[i] += accelerations.x[i] * halfTime;
+				velocityY[i] += accelerations.y[i] * halfTime;
+			}
+		}
+	};
+	auto centralDrift = [&]()
+	{
+		std::array<T, 2> momentum = parallelSum<T, 2>(jobs, arena, count, reduction, [&](std::size_t i, std::array<T, 2>& terms)
+		{
+			terms[0] = i != central ? mass[i] * velocityX[i] : T();
+			terms[1] = i != central ? mass[i] * velocityY[i] : T();
+		});
+		Vector_2d<T> shift = Vector_2d<T>(momentum[0], momentum[1]) / centralMass * halfTime;
+		jobs.parallelFor(count, JOB_MIN_BALLS, [&](std::size_t begin, std::size_t end)
+		{
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				if (i != central)
+				{
+					positionX[i] += shift.x;
+					positionY[i] += shift.y;
+				}
+			}
+		}, arena);
+	};
+
+	kick();
+	centralDrift();
+	T mu = balls.gravity * centralMass;
+	jobs.parallelFor(count, JOB_MIN_ROWS, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			if (i == central)
+				continue;
+
+			Vector_2d<T> position(positionX[i], positionY[i]);
+			Vector_2d<T> velocity(velocityX[i], velocityY[i]);
+			if (!keplerDrift(position, velocity, mu, elapsedTime))
+			{
+				velocity -= mu * normalizeVector(position) / distanceSquared(position) * elapsedTime;
+				position += velocity * elapsedTime;
+			}
+			positionX[i] = position.x;
+			positionY[i] = position.y;
+			velocityX[i] = velocity.x;
+			velocityY[i] = velocity.y;
+		}
+	}, arena);
+	centralDrift();
+	kick();
+
+	//Back to screen coordinates
+	centrePosition += centreVelocity * elapsedTime;
+	std::array<T, 4> others = parallelSum<T, 4>(jobs, arena, count, reduction, [&](std::size_t i, std::array<T, 4>& terms)
+	{
+		bool other = i != central;
+		terms[0] = other ? mass[i] * positionX[i] : T();
+		terms[1] = other ? mass[i] * positionY[i] : T();
+		terms[2] = other ? mass[i] * velocityX[i] : T();
+		terms[3] = other ? mass[i] * velocityY[i] : T();
+	});
+	Vector_2d<T> centralPosition = centrePosition - Vector_2d<T>(others[0], others[1]) / totalMass;
+	Vector_2d<T> centralVelocity = centreVelocity - Vector_2d<T>(others[2], others[3]) / centralMass;
+	positionX[central] = centralPosition.x;
+	positionY[central] = centralPosition.y;
+	velocityX[central] = centralVelocity.x;
+	velocityY[central] = centralVelocity.y;
+	jobs.parallelFor(count, JOB_MIN_BALLS, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			if (i != central)
+			{
+				positionX[i] += centralPosition.x;
+				positionY[i] += centralPosition.y;
+				velocityX[i] += centreVelocity.x;
+				velocityY[i] += centreVelocity.y;
+			}
+		}
+	}, arena);
+}
+
+template <typename T>
+void storePreviousPositions(ParticleStore<T>& balls)
+{
+	storePreviousPositions(balls, 0, balls.size());
+}
+
+template <typename T>
+void storePreviousPositions(ParticleStore<T>& balls, std::size_t begin, std::size_t end)
+{
+	std::copy(balls.positionX.begin() + begin, balls.positionX.begin() + end, balls.previousPositionX.begin() + begin);
+	std::copy(balls.positionY.begin() + begin, balls.positionY.begin() + end, balls.previousPositionY.begin() + begin);
+}
+
+template <typename T>
+void clampAndWrap(ParticleStore<T>& balls)
+{
+	std::size_t count = balls.size();
+	T* positionX = balls.positionX.data();
+	T* positionY = balls.positionY.data();
+	T* velocityX = balls.velocityX.data();
+	T* velocityY = balls.velocityY.data();
+
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		//Two balls right on top of each other pull infinitely hard and end up nowhere
+		if (positionX[i] != positionX[i] || positionY[i] != positionY[i])
+		{
+			balls.markForRemoval(i);
+			continue;
+		}
+
+		//border collisions
+		/*if (positionX[i] - radius[i] < 0 || positionX[i] + radius[i] > SCREEN_WIDTH)
+		{
+			positionX[i] -= velocityX[i];
+			velocityX[i] = -velocityX[i];
+		}
+		if (positionY[i] - radius[i] < 0 || positionY[i] + radius[i] > SCREEN_HEIGHT)
+		{
+			positionY[i] -= velocityY[i];
+			velocityY[i] = -velocityY[i];
+		}*/
+
+		//clamp down the velocity
+		if (velocityX[i] * velocityX[i] + velocityY[i] * velocityY[i] <= 0.001)
+		{
+			velocityX[i] = 0.0;
+			velocityY[i] = 0.0;
+		}
+
+		//wraping the ball
+		if (positionX[i] < 0)
+		{
+			positionX[i] = SCREEN_WIDTH;
+		}
+		if (positionX[i] > SCREEN_WIDTH)
+		{
+			positionX[i] = 0;
+		}
+		if (positionY[i] < 0)
+		{
+			positionY[i] = SCREEN_HEIGHT;
+		}
+		if (positionY[i] > SCREEN_HEIGHT)
+		{
+			positionY[i] = 0;
+		}
+	}
+}
+
+template <typename T>
+void resolveCollision(ParticleStore<T>& balls, std::size_t first, std::size_t second)
+{
+	PhysicsBall<T> ball = balls[first];
+	PhysicsBall<T> otherBall = balls[second];
+	T mass = ball.getMass();
+	T otherMass = otherBall.getMass();
+
+	//Normal collisions
+	Vector_2d<T> normal = getVectorFromPositions(otherBall.getPosition(), ball.getPosition());
+
+	Vector_2d<T> displacement = normalizeVector(normal) * (ball.getRadius() + otherBall.getRadius() - length(normal));
+	ball.setPosition(ball.getPosition() + displacement / 2);
+	otherBall.setPosition(otherBall.getPosition() - displacement / 2);
+
+	normal = normalizeVector(normal);
+	Vector_2d<T> tangent = getPerpendicularVector(normal);
+
+	Vector_2d<T> normalVelocity = projectVector(ball.getVelocity(), normal);
+	Vector_2d<T> tangentialVelocity = projectVector(ball.getVelocity(), tangent);
+
+	Vector_2d<T> otherNormalVelocity = projectVector(otherBall.getVelocity(), normal);
+	Vector_2d<T> otherTangentialVelocity = projectVector(otherBall.getVelocity(), tangent);
+
+	Vector_2d<T> velocity = tangentialVelocity + ((mass - otherMass) * normalVelocity + 2 * otherMass * otherNormalVelocity) / (mass + otherMass);
+	Vector_2d<T> otherVelocity = otherTangentialVelocity + balls.restitution * (2 * mass * normalVelocity + (otherMass - mass) * otherNormalVelocity) / (mass + otherMass);
+
+	ball.setVelocity(velocity * balls.restitution);
+	otherBall.setVelocity(otherVelocity * balls.restitution);
+
+	/*
+	//Wonky collisions 
+	
+	double dist = std::sqrt(distanceSquared(m_position, otherBall.m_position));
+
+	double nx = (otherBall.m_position.x - m_position.x) / dist;
+	double ny = (otherBall.m_position.y - m_position.y) / dist;
+
+	double tx = -ny;
+	double ty = nx;
+
+	double kx = (b1.m_velocity.x - b2.m_velocity.x);
+	double ky = (b1.m_velocity.y - b2.m_velocity.y);
+	double p = 2.0 * (nx * kx + ny * ky) / (b1.m_mass + b2.m_mass);
+	b1.m_velocity.x = b1.m_velocity.x - p * b2.m_mass * nx;
+	b1.m_velocity.y = b1.m_velocity.y - p * b2.m_mass * ny;
+	b2.m_velocity.x = b2.m_velocity.x + p * b1.m_mass * nx;
+	b2.m_velocity.y = b2.m_velocity.y + p * b1.m_mass * ny;
+	*/
+}
+
+template <typename T>
+bool overlapping(ParticleStore<T>& balls, std::size_t first, std::size_t second)
+{
+	T radiusSum = balls.radius[first] + balls.radius[second];
+	return distanceSquared(balls.positionX[second], balls.positionY[second], balls.positionX[first], balls.positionY[first]) <= radiusSum * radiusSum;
+}
+
+//Collects the overlapping pairs first, then resolves them in the same order as checking every
+//pair directly would. A pair pushed apart by an earlier one is skipped.
+template <typename T>
+void resolveCollisions(ParticleStore<T>& balls, ContactLists& contactLists, FrameArena& arena)
+{
+	Contacts contacts(balls.size(), contactLists, arena);
+	findContacts(balls, contacts, 0, balls.size(), 0);
+	resolveContacts(balls, contacts);
+}
+
+//The broadphase: every overlapping pair whose first ball is in the range, each pair once with
+//the lower index first. thread is the list the pairs go in, the one of the job thread running it.
+template <typename T>
+void findContacts(ParticleStore<T>& balls, Contacts& contacts, std::size_t begin, std::size_t end, int thread)
+{
+	std::size_t count = balls.size();
+	std::vector<Contact>& found = contacts.lists->lists[thread];
+
+	for (std::size_t i = begin; i < end; ++i)
+	{
+		std::size_t first = found.size();
+		for (std::size_t j = i + 1; j < count; ++j)
+		{
+			if (overlapping(balls, i, j))
+				found.push_back(Contact{ (std::uint32_t)i, (std::uint32_t)j });
+		}
+
+		contacts.rowThreads[i] = (std::uint16_t)thread;
+		contacts.rowStarts[i] = (std::uint32_t)first;
+		contacts.rowSizes[i] = (std::uint32_t)(found.size() - first);
+	}
+}
+
+//The narrowphase: one contact after the other, each one moves balls the next ones look at
+template <typename T>
+void resolveContacts(ParticleStore<T>& balls, const Contacts& contacts)
+{
+	std::size_t count = balls.size();
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		for (std::uint32_t k = 0; k < contacts.rowSizes[i]; ++k)
+		{
+			const Contact& contact = contacts.get(i, k);
+			if (overlapping(balls, contact.first, contact.second))
+				resolveCollision(balls, contact.first, contact.second);
+		}
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+//Sorts order so that keys[order[i]] goes up, a byte of the key per pass starting from the
+//lowest. Every pass counts the digits of each chunk in parallel and then scatters each chunk
+//in parallel, a chunk per job thread at most. It's stable, so equal keys keep their order in order.
+inline void radixSort(JobSystem& jobs, FrameVector<std::uint32_t>& order, const FrameVector<std::uint32_t>& keys, FrameArena& arena)
+{
+	const std::size_t DIGITS = 256;
+	std::size_t count = order.size();
+
+	std::size_t chunks = count / RADIX_SORT_CHUNK + 1;
+	std::size_t threads = (std::size_t)jobs.getThreadCount();
+	if (chunks > threads)
+		chunks = threads;
+	std::size_t chunkSize = (count + chunks - 1) / chunks;
+
+	FrameVector<std::uint32_t> buffer(count, 0, arena);
+	FrameVector<std::uint32_t> offsets(chunks * DIGITS, 0, arena);
+	std::uint32_t* source = order.data();
+	std::uint32_t* destination = buffer.data();
+
+	for (int shift = 0; shift < 32; shift += 8)
+	{
+		std::fill(offsets.begin(), offsets.end(), 0);
+		jobs.parallelFor(chunks, 1, [&](std::size_t firstChunk, std::size_t lastChunk)
+		{
+			for (std::size_t chunk = firstChunk; chunk < lastChunk; ++chunk)
+			{
+				std::uint32_t* histogram = &offsets[chunk * DIGITS];
+				std::size_t end = std::min((chunk + 1) * chunkSize, count);
+				for (std::size_t i = chunk * chunkSize; i < end; ++i)
+					++histogram[keys[source[i]] >> shift & 0xff];
+			}
+		}, arena);
+
+		//Digit by digit and chunk by chunk within a digit, so earlier chunks stay first
+		std::uint32_t offset = 0;
+		for (std::size_t digit = 0; digit < DIGITS; ++digit)
+		{
+			for (std::size_t chunk = 0; chunk < chunks; ++chunk)
+			{
+				std::uint32_t digitCount = offsets[chunk * DIGITS + digit];
+				offsets[chunk * DIGITS + digit] = offset;
+				offset += digitCount;
+			}
+		}
+
+		jobs.parallelFor(chunks, 1, [&](std::size_t firstChunk, std::size_t lastChunk)
+		{
+			for (std::size_t chunk = firstChunk; chunk < lastChunk; ++chunk)
+			{
+				std::uint32_t* next = &offsets[chunk * DIGITS];
+				std::size_t end = std::min((chunk + 1) * chunkSize, count);
+				for (std::size_t i = chunk * chunkSize; i < end; ++i)
+					destination[next[keys[source[i]] >> shift & 0xff]++] = source[i];
+			}
+		}, arena);
+
+		std::swap(source, destination);
+	}
+	//Four passes, so the result is back in order
+}
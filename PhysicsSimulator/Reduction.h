@@ -0,0 +1,167 @@
+#pragma once
+
+//Parallel sums over the balls. Floating point addition isn't associative, so a sum split up
+//by thread count comes out differently with a different number of threads. The deterministic
+//mode splits into blocks of REDUCTION_BLOCK balls whatever the thread count, adds within a
+//block with Neumaier's compensated summation and combines the blocks in a fixed pairwise tree,
+//so the result is the same bit for bit on 1 thread or 64. That costs about four additions and
+//a comparison per term instead of one. Only the O(n) sums pay it: each ball's force is already
+//summed by one thread in a fixed order, so the O(n^2) forces don't depend on the thread count
+//anyway. --check-determinism runs an ensemble on 1 thread and on several and compares hashState.
+enum reductionModes
+{
+	fastReduction, //one plain sum per piece of work, the pieces depend on the thread count
+	deterministicReduction,
+	max_reductionModes
+};
+
+//Neumaier's variant of Kahan summation, also right when a term is bigger than the sum so far
+template <typename T>
+struct CompensatedSum
+{
+	void add(T term)
+	{
+		using std::abs;
+		T total = sum + term;
+		if (abs(sum) >= abs(term))
+			compensation += (sum - total) + term;
+		else
+			compensation += (term - total) + sum;
+		sum = total;
+	}
+	T get() const { return sum + compensation; }
+
+	T sum = T();
+	T compensation = T(); //the low order bits the additions lost
+};
+
+//N sums at once over [0, count), function(i, terms) sets ball i's N terms
+template <typename T, int N, typename Function>
+std::array<T, N> parallelSum(JobSystem& jobs, FrameArena& arena, std::size_t count, reductionModes mode, Function function)
+{
+	std::array<T, N> result;
+	result.fill(T());
+	if (count == 0)
+		return result;
+
+	bool deterministic = deterministicReduction == mode;
+	std::size_t pieces = (std::size_t)jobs.getThreadCount() * JOB_PIECES_PER_THREAD;
+	std::size_t blockSize = deterministic ? REDUCTION_BLOCK : std::max<std::size_t>((count + pieces - 1) / pieces, JOB_MIN_BALLS);
+	std::size_t blocks = (count + blockSize - 1) / blockSize;
+	T* partials = arena.allocate<T>(blocks * N);
+
+	jobs.parallelFor(blocks, 1, [&](std::size_t firstBlock, std::size_t lastBlock)
+	{
+		for (std::size_t block = firstBlock; block < lastBlock; ++block)
+		{
+			std::size_t end = std::min((block + 1) * blockSize, count);
+			std::array<T, N> terms;
+			if (deterministic)
+			{
+				CompensatedSum<T> sums[N];
+				for (std::size_t i = block * blockSize; i < end; ++i)
+				{
+					function(i, terms);
+					for (int k = 0; k < N; ++k)
+						sums[k].add(terms[k]);
+				}
+				for (int k = 0; k < N; ++k)
+					partials[block * N + k] = sums[k].get();
+			}
+			else
+			{
+				std::array<T, N> sums;
+				sums.fill(T());
+				for (std::size_t i = block * blockSize; i < end; ++i)
+				{
+					function(i, terms);
+					for (int k = 0; k < N; ++k)
+						sums[k] += terms[k];
+				}
+				for (int k = 0; k < N; ++k)
+					partials[block * N + k] = sums[k];
+			}
+		}
+	}, arena);
+
+	//Pairwise, (0+1)+(2+3) and so on, the shape only depends on the number of blocks
+	for (std::size_t stride = 1; stride < blocks; stride *= 2)
+	{
+		for (std::size_t block = 0; block + stride < blocks; block += 2 * stride)
+		{
+			for (int k = 0; k < N; ++k)
+				partials[block * N + k] += partials[(block + stride) * N + k];
+		}
+	}
+	for (int k = 0; k < N; ++k)
+		result[k] = partials[k];
+	return result;
+}
+
+//Totals for checking how well an integrator conserves things
+struct Conserved
+{
+	double kineticEnergy;
+	double potentialEnergy;
+	Vector_2d<double> momentum;
+};
+
+//The potential energy goes through every pair, it's as expensive as a step
+template <typename T>
+Conserved measureConserved(ParticleStore<T>& balls, JobSystem& jobs, FrameArena& arena, reductionModes mode)
+{
+	std::size_t count = balls.size();
+	const T* positionX = balls.positionX.data();
+	const T* positionY = balls.positionY.data();
+	const T* velocityX = balls.velocityX.data();
+	const T* velocityY = balls.velocityY.data();
+	const T* mass = balls.mass.data();
+
+	//In double whatever the physics runs in, fixed point would overflow
+	std::array<double, 4> sums = parallelSum<double, 4>(jobs, arena, count, mode, [&](std::size_t i, std::array<double, 4>& terms)
+	{
+		double m = static_cast<double>(mass[i]);
+		double vx = static_cast<double>(velocityX[i]);
+		double vy = static_cast<double>(velocityY[i]);
+
+		//Each pair once, the later ball of the pair counts it
+		double potential = 0.0;
+		for (std::size_t j = 0; j < i; ++j)
+		{
+			double dx = static_cast<double>(positionX[j] - positionX[i]);
+			double dy = static_cast<double>(positionY[j] - positionY[i]);
+			double distance = std::sqrt(dx * dx + dy * dy);
+			if (distance > 0.0)
+				potential -= balls.gravity * m * static_cast<double>(mass[j]) / distance;
+		}
+
+		terms[0] = 0.5 * m * (vx * vx + vy * vy);
+		terms[1] = potential;
+		terms[2] = m * vx;
+		terms[3] = m * vy;
+	});
+
+	return Conserved{ sums[0], sums[1], Vector_2d<double>(sums[2], sums[3]) };
+}
+
+//FNV-1a over the exact bits of every ball's position, velocity, radius and mass, two runs only
+//hash the same if they came out the same bit for bit
+template <typename T>
+std::uint64_t hashState(ParticleStore<T>& balls)
+{
+	std::uint64_t hash = 14695981039346656037ull;
+	auto add = [&](const auto& values)
+	{
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values.data());
+		for (std::size_t i = 0; i < values.size() * sizeof(T); ++i)
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+	};
+
+	add(balls.positionX);
+	add(balls.positionY);
+	add(balls.velocityX);
+	add(balls.velocityY);
+	add(balls.radius);
+	add(balls.mass);
+	return hash;
+}
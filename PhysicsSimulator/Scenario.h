@@ -0,0 +1,160 @@
+#pragma once
+
+const int NO_SCENARIO_EVENT = -1;
+
+class ScenarioRunner;
+
+//A scripted sequence of changes to the simulation, written as a C++20 coroutine that co_awaits
+//WaitFor, WaitUntil or WaitForEvent in between. Scripts don't have threads of their own: a
+//ScenarioRunner resumes them on the simulation thread between steps, so they can change the
+//balls directly, and a script waiting for 5 simulated seconds takes as little wall time as the
+//steps do.
+class Scenario
+{
+public:
+	struct promise_type
+	{
+		Scenario get_return_object() { return Scenario(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		//Nothing runs until the runner starts it
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		//Kept until the runner sees it's done and destroys it
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+
+		//What it's waiting for, a time unless there's an event or a condition
+		ScenarioRunner* runner = nullptr;
+		double wakeTime = 0.0; //simulated seconds
+		int event = NO_SCENARIO_EVENT;
+		std::function<bool()> condition;
+	};
+
+	Scenario(Scenario&& other) noexcept : m_handle(other.m_handle) { other.m_handle = nullptr; }
+	Scenario(const Scenario&) = delete;
+	Scenario& operator=(const Scenario&) = delete;
+	~Scenario();
+private:
+	friend class ScenarioRunner;
+	explicit Scenario(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+	std::coroutine_handle<promise_type> m_handle;
+};
+
+//Resumes scripts at step boundaries once what they wait for has happened
+class ScenarioRunner
+{
+public:
+	ScenarioRunner() = default;
+	ScenarioRunner(const ScenarioRunner&) = delete;
+	ScenarioRunner& operator=(const ScenarioRunner&) = delete;
+	~ScenarioRunner();
+
+	//Runs up to its first co_await at the next update()
+	void start(Scenario scenario);
+	//For scripts waiting on it at the next update(), events aren't kept after that
+	void signal(int event) { m_events.push_back(event); }
+	//Between steps, time is the simulated seconds so far. Returns true if any script ran.
+	bool update(double time);
+
+	double getTime() const { return m_time; }
+	bool empty() const { return m_scripts.empty(); }
+private:
+	std::vector<std::coroutine_handle<Scenario::promise_type>> m_scripts;
+	std::vector<int> m_events;
+	double m_time = 0.0;
+};
+
+//co_await WaitFor{ seconds } of simulated time
+struct WaitFor
+{
+	double seconds;
+
+	bool await_ready() const { return seconds <= 0.0; }
+	void await_suspend(std::coroutine_handle<Scenario::promise_type> handle) const
+	{
+		handle.promise().wakeTime = handle.promise().runner->getTime() + seconds;
+	}
+	void await_resume() const {}
+};
+
+//co_await WaitUntil{ condition }, checked between every step
+struct WaitUntil
+{
+	std::function<bool()> condition;
+
+	bool await_ready() const { return condition(); }
+	void await_suspend(std::coroutine_handle<Scenario::promise_type> handle) { handle.promise().condition = std::move(condition); }
+	void await_resume() const {}
+};
+
+//co_await WaitForEvent{ event } signalled after the script started waiting
+struct WaitForEvent
+{
+	int event;
+
+	bool await_ready() const { return false; }
+	void await_suspend(std::coroutine_handle<Scenario::promise_type> handle) const { handle.promise().event = event; }
+	void await_resume() const {}
+};
+
+inline Scenario::~Scenario()
+{
+	//Only if it was never started
+	if (m_handle)
+		m_handle.destroy();
+}
+
+inline ScenarioRunner::~ScenarioRunner()
+{
+	for (std::coroutine_handle<Scenario::promise_type> script : m_scripts)
+		script.destroy();
+}
+
+inline void ScenarioRunner::start(Scenario scenario)
+{
+	std::coroutine_handle<Scenario::promise_type> script = scenario.m_handle;
+	scenario.m_handle = nullptr;
+	script.promise().runner = this;
+	script.promise().wakeTime = m_time;
+	m_scripts.push_back(script);
+}
+
+inline bool ScenarioRunner::update(double time)
+{
+	m_time = time;
+	bool ran = false;
+
+	//Only the ones there already, a script can start another one while it runs
+	std::size_t count = m_scripts.size();
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		std::coroutine_handle<Scenario::promise_type> script = m_scripts[i];
+		Scenario::promise_type& promise = script.promise();
+
+		bool due;
+		if (promise.event != NO_SCENARIO_EVENT)
+			due = std::find(m_events.begin(), m_events.end(), promise.event) != m_events.end();
+		else if (promise.condition)
+			due = promise.condition();
+		else
+			due = m_time >= promise.wakeTime;
+		if (!due)
+			continue;
+
+		promise.event = NO_SCENARIO_EVENT;
+		promise.condition = nullptr;
+		script.resume();
+		ran = true;
+	}
+	m_events.clear();
+
+	for (std::size_t i = m_scripts.size(); i-- > 0;)
+	{
+		if (m_scripts[i].done())
+		{
+			m_scripts[i].destroy();
+			m_scripts.erase(m_scripts.begin() + i);
+		}
+	}
+	return ran;
+}
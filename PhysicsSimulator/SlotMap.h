@@ -0,0 +1,157 @@
+#pragma once
+
+const std::uint32_t NO_SLOT = 0xffffffff;
+
+//Stable reference to something stored in dense arrays. The generation tells apart
+//everything that has used the same slot, so a handle to a removed entry stays invalid.
+struct Handle
+{
+	std::uint32_t slot = NO_SLOT;
+	std::uint32_t generation = 0;
+
+	bool operator==(const Handle& other) const { return slot == other.slot && generation == other.generation; }
+};
+
+//Maps handles to indices of dense arrays owned by someone else. Inserting, removing
+//and validating are O(1); the owner moves its elements the same way the map says it did.
+class SlotMap
+{
+public:
+	std::size_t size() const { return m_denseToSlot.size(); }
+	//Every slot ever used, for tables indexed by Handle::slot
+	std::size_t slotCount() const { return m_slots.size(); }
+	std::size_t getMemoryUsage() const;
+	void reserve(std::size_t capacity);
+	void clear();
+
+	//The new entry is at index size() - 1
+	Handle insert();
+	//Swap-remove: the last entry moves into the removed index, which is returned
+	std::size_t erase(Handle handle);
+	//For reordering the dense arrays
+	void swap(std::size_t first, std::size_t second);
+	//Keeps only the entries at the dense indices order[0..count), moved to 0..count-1 in that
+	//order, and erases all the others. For removing and reordering many entries in one pass.
+	void compact(const std::uint32_t* order, std::size_t count);
+
+	bool isValid(Handle handle) const;
+	std::size_t indexOf(Handle handle) const { return m_slots[handle.slot].index; }
+	Handle handleAt(std::size_t index) const;
+private:
+	struct Slot
+	{
+		std::uint32_t index; //dense index when alive, next free slot when not
+		std::uint32_t generation;
+	};
+
+	std::vector<Slot> m_slots;
+	std::vector<std::uint32_t> m_denseToSlot;
+	std::uint32_t m_freeSlot = NO_SLOT;
+	std::vector<std::uint32_t> m_scratch; //kept between calls so compacting doesn't allocate
+};
+
+inline void SlotMap::reserve(std::size_t capacity)
+{
+	m_slots.reserve(capacity);
+	m_denseToSlot.reserve(capacity);
+	m_scratch.reserve(capacity);
+}
+
+inline std::size_t SlotMap::getMemoryUsage() const
+{
+	return m_slots.capacity() * sizeof(Slot) + (m_denseToSlot.capacity() + m_scratch.capacity()) * sizeof(std::uint32_t);
+}
+
+inline void SlotMap::clear()
+{
+	//Keep the generations so old handles stay invalid
+	m_freeSlot = NO_SLOT;
+	for (std::size_t i = m_slots.size(); i-- > 0;)
+	{
+		if (m_slots[i].index < m_denseToSlot.size() && m_denseToSlot[m_slots[i].index] == i)
+			++m_slots[i].generation;
+		m_slots[i].index = m_freeSlot;
+		m_freeSlot = i;
+	}
+	m_denseToSlot.clear();
+}
+
+inline Handle SlotMap::insert()
+{
+	std::uint32_t slot = m_freeSlot;
+	if (slot != NO_SLOT)
+	{
+		m_freeSlot = m_slots[slot].index;
+	}
+	else
+	{
+		slot = m_slots.size();
+		m_slots.push_back(Slot{ 0, 0 });
+	}
+
+	m_slots[slot].index = m_denseToSlot.size();
+	m_denseToSlot.push_back(slot);
+
+	return Handle{ slot, m_slots[slot].generation };
+}
+
+inline std::size_t SlotMap::erase(Handle handle)
+{
+	std::uint32_t index = m_slots[handle.slot].index;
+	std::uint32_t last = m_denseToSlot.size() - 1;
+
+	m_denseToSlot[index] = m_denseToSlot[last];
+	m_slots[m_denseToSlot[index]].index = index;
+	m_denseToSlot.pop_back();
+
+	++m_slots[handle.slot].generation;
+	m_slots[handle.slot].index = m_freeSlot;
+	m_freeSlot = handle.slot;
+
+	return index;
+}
+
+inline void SlotMap::swap(std::size_t first, std::size_t second)
+{
+	std::swap(m_denseToSlot[first], m_denseToSlot[second]);
+	m_slots[m_denseToSlot[first]].index = first;
+	m_slots[m_denseToSlot[second]].index = second;
+}
+
+inline void SlotMap::compact(const std::uint32_t* order, std::size_t count)
+{
+	m_scratch.assign(m_denseToSlot.begin(), m_denseToSlot.end());
+
+	//Every entry starts out erased, the kept ones get a new index
+	for (std::uint32_t slot : m_scratch)
+		m_slots[slot].index = NO_SLOT;
+
+	m_denseToSlot.resize(count);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		std::uint32_t slot = m_scratch[order[i]];
+		m_denseToSlot[i] = slot;
+		m_slots[slot].index = i;
+	}
+
+	for (std::uint32_t slot : m_scratch)
+	{
+		if (m_slots[slot].index == NO_SLOT)
+		{
+			++m_slots[slot].generation;
+			m_slots[slot].index = m_freeSlot;
+			m_freeSlot = slot;
+		}
+	}
+}
+
+inline bool SlotMap::isValid(Handle handle) const
+{
+	return handle.slot < m_slots.size() && m_slots[handle.slot].generation == handle.generation;
+}
+
+inline Handle SlotMap::handleAt(std::size_t index) const
+{
+	std::uint32_t slot = m_denseToSlot[index];
+	return Handle{ slot, m_slots[slot].generation };
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+//Space-filling curve keys: sorting balls by them puts balls that are close on the screen
+//close together in memory
+
+enum curves
+{
+	noCurve,
+	mortonCurve, //cheap, but jumps across the screen at the edges of every quadrant
+	hilbertCurve, //a bit more work, neighbours on the curve are always neighbours on the screen
+	max_curves
+};
+
+//Spreads the low 16 bits of value out to the even bits
+inline std::uint32_t spreadBits(std::uint32_t value)
+{
+	value &= 0x0000ffff;
+	value = (value | (value << 8)) & 0x00ff00ff;
+	value = (value | (value << 4)) & 0x0f0f0f0f;
+	value = (value | (value << 2)) & 0x33333333;
+	value = (value | (value << 1)) & 0x55555555;
+	return value;
+}
+
+//Z-order curve index of a point on a 65536x65536 grid
+inline std::uint32_t mortonCode(std::uint32_t x, std::uint32_t y)
+{
+	return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+//Hilbert curve index of a point on a 65536x65536 grid
+inline std::uint32_t hilbertCode(std::uint32_t x, std::uint32_t y)
+{
+	std::uint32_t code = 0;
+	for (std::uint32_t s = 1 << 15; s > 0; s >>= 1)
+	{
+		std::uint32_t rx = (x & s) > 0;
+		std::uint32_t ry = (y & s) > 0;
+		code += s * s * ((3 * rx) ^ ry);
+
+		//Rotate the quadrant so the curve inside it lines up
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = 0xffff - x;
+				y = 0xffff - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return code;
+}
+
+inline std::uint32_t curveCode(curves curve, std::uint32_t x, std::uint32_t y)
+{
+	return hilbertCurve == curve ? hilbertCode(x, y) : mortonCode(x, y);
+}
+
+//Screen position to grid coordinate, anything off the screen goes to the nearest edge
+inline std::uint32_t curveCoordinate(double position, double screenSize)
+{
+	double scaled = position / screenSize * 65535.0;
+	if (!(scaled > 0.0))
+		return 0;
+	if (scaled > 65535.0)
+		return 65535;
+	return (std::uint32_t)scaled;
+}
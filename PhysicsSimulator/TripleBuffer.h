@@ -0,0 +1,46 @@
+#pragma once
+
+//Hands the newest of a stream of values from one writer thread to one reader thread without
+//either of them ever waiting. Each side has a buffer of its own and the third one sits in the
+//middle: the writer publishes by swapping its buffer with the middle one, the reader takes the
+//newest value by swapping its buffer with the middle one. Values the reader was too slow
+//for are skipped.
+template <typename T>
+class TripleBuffer
+{
+public:
+	//Writer side: fill this in, then publish() it
+	T& getWriteBuffer() { return m_buffers[m_writeIndex]; }
+	void publish();
+
+	//Reader side: returns true if something was published since the last call,
+	//getReadBuffer() is the newest value either way
+	bool update();
+	T& getReadBuffer() { return m_buffers[m_readIndex]; }
+private:
+	static const int FRESH = 4; //set in m_middle by publish(), cleared by update()
+
+	T m_buffers[3];
+	alignas(PARTICLE_ALIGNMENT) std::atomic<int> m_middle{ 1 };
+	int m_writeIndex = 0;
+	alignas(PARTICLE_ALIGNMENT) int m_readIndex = 2; //on its own cache line, the reader thread writes it
+};
+
+template <typename T>
+void TripleBuffer<T>::publish()
+{
+	//Release makes the writes to the buffer visible to whoever swaps it out of the middle
+	int previous = m_middle.exchange(m_writeIndex | FRESH, std::memory_order_acq_rel);
+	m_writeIndex = previous & ~FRESH;
+}
+
+template <typename T>
+bool TripleBuffer<T>::update()
+{
+	if (!(m_middle.load(std::memory_order_relaxed) & FRESH))
+		return false;
+
+	int previous = m_middle.exchange(m_readIndex, std::memory_order_acq_rel);
+	m_readIndex = previous & ~FRESH;
+	return true;
+}
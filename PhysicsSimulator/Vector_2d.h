@@ -1,130 +1,176 @@
 #pragma once
 
-struct Vector_2d
+//2d vector of any scalar (float, double or Fixed). Everything is inline and constexpr so the
+//header can be included anywhere and used in constant expressions.
+template <typename T>
+struct alignas(2 * sizeof(T)) Vector_2d
 {
-	double x, y;
+	T x, y;
 };
 
-Vector_2d operator-(const Vector_2d& p)
+//Scalar arguments aren't deduced, so 0.5 * vector works for every T
+template <typename T>
+using Scalar_t = std::type_identity_t<T>;
+
+template <typename To, typename From>
+constexpr Vector_2d<To> vector_cast(const Vector_2d<From>& p)
 {
-	return Vector_2d{ -p.x, -p.y };
+	return Vector_2d<To>{ static_cast<To>(p.x), static_cast<To>(p.y) };
 }
 
-Vector_2d operator+(const Vector_2d& p1, const Vector_2d& p2)
+template <typename T>
+constexpr Vector_2d<T> operator-(const Vector_2d<T>& p)
 {
-	return Vector_2d{ p1.x + p2.x, p1.y + p2.y };
+	return Vector_2d<T>{ -p.x, -p.y };
 }
 
-Vector_2d operator-(const Vector_2d& p1, const Vector_2d& p2)
+template <typename T>
+constexpr Vector_2d<T> operator+(const Vector_2d<T>& p1, const Vector_2d<T>& p2)
 {
-	return Vector_2d{ p1.x - p2.x, p1.y - p2.y };
+	return Vector_2d<T>{ p1.x + p2.x, p1.y + p2.y };
 }
 
-Vector_2d operator*(double a, const Vector_2d& p)
+template <typename T>
+constexpr Vector_2d<T> operator-(const Vector_2d<T>& p1, const Vector_2d<T>& p2)
 {
-	return Vector_2d{ p.x * a, p.y * a };
+	return Vector_2d<T>{ p1.x - p2.x, p1.y - p2.y };
 }
 
-Vector_2d operator*(const Vector_2d& p, double a)
+template <typename T>
+constexpr Vector_2d<T> operator*(Scalar_t<T> a, const Vector_2d<T>& p)
+{
+	return Vector_2d<T>{ p.x * a, p.y * a };
+}
+
+template <typename T>
+constexpr Vector_2d<T> operator*(const Vector_2d<T>& p, Scalar_t<T> a)
 {
 	return a * p;
 }
 
-Vector_2d operator/(const Vector_2d& p, double a)
+template <typename T>
+constexpr Vector_2d<T> operator/(const Vector_2d<T>& p, Scalar_t<T> a)
 {
-	return Vector_2d{ p.x / a, p.y / a };
+	return Vector_2d<T>{ p.x / a, p.y / a };
 }
 
-Vector_2d operator+=(Vector_2d& p1, const Vector_2d& p2)
+template <typename T>
+constexpr Vector_2d<T> operator+=(Vector_2d<T>& p1, const Vector_2d<T>& p2)
 {
 	p1 = p1 + p2;
 	return p1;
 }
 
-Vector_2d operator-=(Vector_2d& p1, const Vector_2d& p2)
+template <typename T>
+constexpr Vector_2d<T> operator-=(Vector_2d<T>& p1, const Vector_2d<T>& p2)
 {
 	p1 = p1 - p2;
 	return p1;
 }
 
-Vector_2d operator*=(Vector_2d& p, const double a)
+template <typename T>
+constexpr Vector_2d<T> operator*=(Vector_2d<T>& p, const Scalar_t<T> a)
 {
 	p = p * a;
 	return p;
 }
 
-Vector_2d operator/=(Vector_2d& p, const double a)
+template <typename T>
+constexpr Vector_2d<T> operator/=(Vector_2d<T>& p, const Scalar_t<T> a)
 {
 	p = p / a;
 	return p;
 }
 
-double distanceSquared(double x1, double y1, double x2 = 0.0, double y2 = 0.0)
+template <typename T>
+constexpr T distanceSquared(T x1, T y1, Scalar_t<T> x2 = T(), Scalar_t<T> y2 = T())
 {
 	return (x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1);
 }
 
-double distanceSquared(Vector_2d a, Vector_2d b = Vector_2d(0.0, 0.0))
+template <typename T>
+constexpr T distanceSquared(Vector_2d<T> a, Vector_2d<T> b = Vector_2d<T>())
 {
 	return distanceSquared(a.x, a.y, b.x, b.y);
 }
 
-double dotProduct(double x1, double y1, double x2, double y2)
+template <typename T>
+constexpr T dotProduct(T x1, T y1, Scalar_t<T> x2, Scalar_t<T> y2)
 {
 	return x1 * x2 + y1 * y2;
 }
 
-double dotProduct(Vector_2d a, Vector_2d b)
+template <typename T>
+constexpr T dotProduct(Vector_2d<T> a, Vector_2d<T> b)
 {
 	return dotProduct(a.x, a.y, b.x, b.y);
 }
 
-double crossProduct(double x1, double y1, double x2, double y2)
+template <typename T>
+constexpr T crossProduct(T x1, T y1, Scalar_t<T> x2, Scalar_t<T> y2)
 {
 	return x1 * y2 - x2 * y1;
 }
 
-double crossProduct(Vector_2d a, Vector_2d b)
+template <typename T>
+constexpr T crossProduct(Vector_2d<T> a, Vector_2d<T> b)
 {
 	return crossProduct(a.x, a.y, b.x, b.y);
 }
 
-Vector_2d getVectorFromPositions(Vector_2d a, Vector_2d b)
+template <typename T>
+constexpr Vector_2d<T> getVectorFromPositions(Vector_2d<T> a, Vector_2d<T> b)
 {
-	return Vector_2d(b.x - a.x, b.y - a.y);
+	return Vector_2d<T>(b.x - a.x, b.y - a.y);
 }
 
 //return a 90 deegres counterclockwise vector
-Vector_2d getPerpendicularVector(Vector_2d vector)
+template <typename T>
+constexpr Vector_2d<T> getPerpendicularVector(Vector_2d<T> vector)
 {
-	return Vector_2d(-vector.y, vector.x);
+	return Vector_2d<T>(-vector.y, vector.x);
 }
 
-double rsqrt(double number)
+constexpr double rsqrt(double number)
 {
 	double y = number;
 	double x2 = y * 0.5;
-	std::int64_t i = *(std::int64_t*)&y;
+	std::int64_t i = std::bit_cast<std::int64_t>(y);
 	// The magic number is for doubles is from https://cs.uwaterloo.ca/~m32rober/rsqrt.pdf
 	i = 0x5fe6eb50c7b537a9 - (i >> 1);
-	y = *(double*)&i;
+	y = std::bit_cast<double>(i);
 	y = y * (1.5 - (x2 * y * y));   // 1st iteration
 	//      y  = y * ( 1.5 - ( x2 * y * y ) );   // 2nd iteration, this can be removed
 	return y;
 }
 
-Vector_2d normalizeVector(Vector_2d a)
+constexpr float rsqrt(float number)
+{
+	float y = number;
+	float x2 = y * 0.5f;
+	std::int32_t i = std::bit_cast<std::int32_t>(y);
+	i = 0x5f3759df - (i >> 1);
+	y = std::bit_cast<float>(i);
+	y = y * (1.5f - (x2 * y * y));   // 1st iteration
+	return y;
+}
+
+template <typename T>
+constexpr Vector_2d<T> normalizeVector(Vector_2d<T> a)
 {
 	return a * rsqrt(distanceSquared(a));
 }
 
-double length(Vector_2d a)
+template <typename T>
+T length(Vector_2d<T> a)
 {
-	return std::sqrt(distanceSquared(a));
+	using std::sqrt;
+	return sqrt(distanceSquared(a));
 }
 
-Vector_2d projectVector(Vector_2d a, Vector_2d b)
+template <typename T>
+constexpr Vector_2d<T> projectVector(Vector_2d<T> a, Vector_2d<T> b)
 {
 	b = normalizeVector(b);
 	return dotProduct(a, b) * b;
-}
\ No newline at end of file
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+//Triangles for a chunk of balls, filled in on any thread and drawn with one SDL_RenderGeometry
+//call, instead of a draw call per line of every circle. Cleared rather than freed between
+//frames, so after the first few frames building one doesn't allocate.
+struct VertexBatch
+{
+	void clear() { vertices.clear(); indices.clear(); }
+	//A fan around the centre, with more segments the bigger it is
+	void addCircle(Vector_2d<double> centre, double radius, SDL_Color color);
+	//A quad a pixel wide
+	void addLine(Vector_2d<double> from, Vector_2d<double> to, SDL_Color color);
+	void addVertex(double x, double y, SDL_Color color);
+
+	std::vector<SDL_Vertex> vertices;
+	std::vector<int> indices;
+};
+
+inline void VertexBatch::addCircle(Vector_2d<double> centre, double radius, SDL_Color color)
+{
+	int segments = std::clamp((int)(radius * CIRCLE_SEGMENTS_PER_PIXEL), CIRCLE_MIN_SEGMENTS, CIRCLE_MAX_SEGMENTS);
+	int first = (int)vertices.size();
+	addVertex(centre.x, centre.y, color);
+
+	//Round the circle by rotating one point, a sin and a cos per circle instead of per vertex
+	double angle = 2.0 * std::_Pi / segments;
+	double cosine = std::cos(angle);
+	double sine = std::sin(angle);
+	double x = radius;
+	double y = 0.0;
+	for (int i = 0; i < segments; ++i)
+	{
+		addVertex(centre.x + x, centre.y + y, color);
+		double rotatedX = x * cosine - y * sine;
+		y = x * sine + y * cosine;
+		x = rotatedX;
+
+		indices.push_back(first);
+		indices.push_back(first + 1 + i);
+		indices.push_back(first + 1 + (i + 1) % segments);
+	}
+}
+
+inline void VertexBatch::addLine(Vector_2d<double> from, Vector_2d<double> to, SDL_Color color)
+{
+	Vector_2d<double> direction = to - from;
+	double lineLength = std::sqrt(direction.x * direction.x + direction.y * direction.y);
+	if (lineLength < 0.5)
+		return;
+
+	//Half a pixel either side
+	Vector_2d<double> side(-direction.y * 0.5 / lineLength, direction.x * 0.5 / lineLength);
+	int first = (int)vertices.size();
+	addVertex(from.x + side.x, from.y + side.y, color);
+	addVertex(from.x - side.x, from.y - side.y, color);
+	addVertex(to.x + side.x, to.y + side.y, color);
+	addVertex(to.x - side.x, to.y - side.y, color);
+
+	indices.push_back(first);
+	indices.push_back(first + 1);
+	indices.push_back(first + 2);
+	indices.push_back(first + 2);
+	indices.push_back(first + 1);
+	indices.push_back(first + 3);
+}
+
+inline void VertexBatch::addVertex(double x, double y, SDL_Color color)
+{
+	SDL_Vertex vertex;
+	vertex.position.x = (float)x;
+	vertex.position.y = (float)y;
+	vertex.color = color;
+	vertex.tex_coord.x = 0.0f;
+	vertex.tex_coord.y = 0.0f;
+	vertices.push_back(vertex);
+}
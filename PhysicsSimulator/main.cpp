@@ -8,10 +8,47 @@
 #include <vector>
 #include <cmath>
 #include <string>
+#include <new>
+#include <bit>
+#include <type_traits>
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <initializer_list>
+#include <coroutine>
+#include <functional>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #include "CircleDrawing.h"
 #include "Constants.h"
 #include "Vector_2d.h"
+#include "Fixed.h"
+#include "Kepler.h"
+#include "FramePacer.h"
+#include "FrameArena.h"
+#include "SlotMap.h"
+#include "Numa.h"
+#include "JobSystem.h"
+#include "CostZones.h"
+#include "SpaceFillingCurve.h"
+#include "RadixSort.h"
+#include "ParticleStore.h"
+#include "Reduction.h"
+#include "Physics.h"
+#include "History.h"
+#include "TripleBuffer.h"
+#include "CommandQueue.h"
+#include "Scenario.h"
+#include "VertexBatch.h"
 
 
 enum mouseButtons
@@ -21,6 +58,74 @@ enum mouseButtons
 	right,
 	max_mouseButtons
 };
+//Every C++ heap allocation goes through these so the frame report can count them
+std::atomic<std::uint64_t> g_heapAllocations = 0;
+
+void* operator new(std::size_t size)
+{
+	++g_heapAllocations;
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	++g_heapAllocations;
+	//malloc doesn't take an alignment everywhere, so over-allocate and keep the real pointer in front
+	std::size_t align = (std::size_t)alignment;
+	void* p = std::malloc(size + align + sizeof(void*));
+	if (!p)
+		throw std::bad_alloc();
+	std::uintptr_t aligned = ((std::uintptr_t)p + sizeof(void*) + align - 1) & ~(std::uintptr_t)(align - 1);
+	((void**)aligned)[-1] = p;
+	return (void*)aligned;
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+	if (p)
+		std::free(((void**)p)[-1]);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t alignment) noexcept
+{
+	operator delete(p, alignment);
+}
+
+//Scalar the physics runs in, pick with PHYSICS_FLOAT or PHYSICS_FIXED_POINT, double by default
+#if defined(PHYSICS_FIXED_POINT)
+using Scalar = Fixed;
+const char* SCALAR_NAME = "fixed point";
+#elif defined(PHYSICS_FLOAT)
+using Scalar = float;
+const char* SCALAR_NAME = "float";
+#else
+using Scalar = double;
+const char* SCALAR_NAME = "double";
+#endif
+
+enum integrators
+{
+	euler,
+	wisdomHolman,
+	max_integrators
+};
+const char* integratorNames[max_integrators] = { "Euler", "Wisdom-Holman" };
+const char* removalPolicyNames[max_removalPolicies] = { "swap", "stable" };
+const char* curveNames[max_curves] = { "none", "Morton", "Hilbert" };
+const char* reductionModeNames[max_reductionModes] = { "fast", "deterministic" };
+
 struct buttonStates
 {
 	bool down = false;
@@ -312,9 +417,7 @@ bool init()
 		}
 		else
 		{
-			//Create vsynced renderer for window
-			//g_renderer = SDL_CreateRenderer(g_window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-			//Create unvsynced renderer
+			//Create unvsynced renderer, vsync is switched by the frame pacer
 			g_renderer = SDL_CreateRenderer(g_window, -1, SDL_RENDERER_ACCELERATED);
 			if (g_renderer == NULL)
 			{
@@ -392,213 +495,1090 @@ void close()
 
 
 
-class PhysicsBall
+//Last ball drawn under the point, or an invalid handle
+Handle findBallAt(ParticleStore<Scalar>& balls, Vector_2d<Scalar> point)
 {
-public:
-	PhysicsBall(double radius, SDL_Color color, Vector_2d position, Vector_2d velocity);
+	for (std::size_t i = balls.size(); i-- > 0;)
+	{
+		if (balls[i].checkCollisionWithPoint(point))
+			return balls[i].getHandle();
+	}
+	return Handle();
+}
 
-	bool checkCollision(const PhysicsBall& otherBall);
-	bool checkCollisionWithPoint(Vector_2d point);
+//Keeps the picked up flag drawing looks at in step with the handle
+void setPickedUpBall(ParticleStore<Scalar>& balls, Handle& pickedUpBall, Handle ball)
+{
+	if (balls.isValid(pickedUpBall))
+		balls.getCold(pickedUpBall).flags &= ~flagPickedUp;
 
-	Vector_2d getPosition() { return m_position; }
-	void setRadius(double radius);
+	pickedUpBall = ball;
+	if (balls.isValid(pickedUpBall))
+		balls.getCold(pickedUpBall).flags |= flagPickedUp;
+}
 
-	void calculateForces(const std::vector<PhysicsBall>& otherBalls);
-	void update(std::vector<PhysicsBall>& otherBalls, buttonStates mouseButtons[], Vector_2d mousePosition, PhysicsBall*& p_pickedUpBall, double elapsedTime);
-	void show(SDL_Renderer* renderer, buttonStates mouseButtons[], Vector_2d mousePosition, PhysicsBall*& p_pickedUpBall);
-private:
-	Vector_2d m_position;
-	Vector_2d m_velocity;
-	Vector_2d m_force;
-	double m_radius;
-	double m_mass;
-	SDL_Color m_color;
+//The ball the mouse has hold of. The left button holds it still under the mouse, the right
+//button lets it carry on moving while a fling is aimed.
+struct Grab
+{
+	Handle ball;
+	bool holding = false;
+	Vector_2d<Scalar> target{ 0, 0 }; //where a held ball is dragged to
 };
 
-PhysicsBall::PhysicsBall(double radius, SDL_Color color, Vector_2d position, Vector_2d velocity = Vector_2d(0, 0))
+//Every step, the ball might have been removed since it was grabbed
+void holdGrabbedBall(ParticleStore<Scalar>& balls, const Grab& grab)
 {
-	m_position = position;
-	m_velocity = velocity;
-	m_force = Vector_2d(0.0, 0.0);
-	m_radius = radius;
-	static double fourOverThree = 4 / 3.0;
-	m_mass = std::_Pi * fourOverThree * m_radius * m_radius * m_radius;
-	m_color = color;
+	if (grab.holding && balls.isValid(grab.ball))
+	{
+		PhysicsBall<Scalar> held = balls.get(grab.ball);
+		held.setVelocity(Vector_2d<Scalar>());
+		held.setPosition(grab.target);
+	}
 }
 
-void PhysicsBall::setRadius(double radius)
+//What the render thread draws, only the fields it reads. The simulation thread copies them out
+//of the balls after every batch of steps and publishes them through a TripleBuffer. The arrays
+//are reserved for the particle budget up front, so publishing doesn't allocate.
+struct SimulationState
+{
+	SimulationState() { reserve(PARTICLE_BUDGET); }
+	std::size_t size() const { return positionX.size(); }
+	void reserve(std::size_t capacity);
+	void copy(ParticleStore<Scalar>& balls);
+	Vector_2d<double> getInterpolatedPosition(std::size_t index, double interpolation) const;
+
+	std::vector<Scalar> positionX;
+	std::vector<Scalar> positionY;
+	std::vector<Scalar> previousPositionX;
+	std::vector<Scalar> previousPositionY;
+	std::vector<Scalar> velocityX;
+	std::vector<Scalar> velocityY;
+	std::vector<Scalar> radius;
+	std::vector<ColdParticle> cold;
+	std::vector<double> forceX; //for the force lines, empty when they aren't drawn
+	std::vector<double> forceY;
+
+	std::uint64_t publishTime = 0; //performance counter when it was published
+	double stepLength = 1.0; //wall seconds between steps, for drawing between the last two
+	int timeWarp = 1; //it was stepped at
+};
+
+void SimulationState::reserve(std::size_t capacity)
 {
-	m_radius = radius; 
-	static double fourOverThree = 4 / 3.0;
-	m_mass = std::_Pi * fourOverThree * m_radius * m_radius * m_radius;
+	positionX.reserve(capacity);
+	positionY.reserve(capacity);
+	previousPositionX.reserve(capacity);
+	previousPositionY.reserve(capacity);
+	velocityX.reserve(capacity);
+	velocityY.reserve(capacity);
+	radius.reserve(capacity);
+	cold.reserve(capacity);
+	forceX.reserve(capacity);
+	forceY.reserve(capacity);
 }
 
-bool PhysicsBall::checkCollision(const PhysicsBall& otherBall)
+void SimulationState::copy(ParticleStore<Scalar>& balls)
 {
-	return distanceSquared(otherBall.m_position, m_position) <= (otherBall.m_radius + m_radius) * (otherBall.m_radius + m_radius);
+	positionX.assign(balls.positionX.begin(), balls.positionX.end());
+	positionY.assign(balls.positionY.begin(), balls.positionY.end());
+	previousPositionX.assign(balls.previousPositionX.begin(), balls.previousPositionX.end());
+	previousPositionY.assign(balls.previousPositionY.begin(), balls.previousPositionY.end());
+	velocityX.assign(balls.velocityX.begin(), balls.velocityX.end());
+	velocityY.assign(balls.velocityY.begin(), balls.velocityY.end());
+	radius.assign(balls.radius.begin(), balls.radius.end());
+	cold.resize(balls.size());
+	for (std::size_t i = 0; i < balls.size(); ++i)
+		cold[i] = balls.coldAt(i);
 }
 
-bool PhysicsBall::checkCollisionWithPoint(Vector_2d point)
+Vector_2d<double> SimulationState::getInterpolatedPosition(std::size_t index, double interpolation) const
 {
-	return distanceSquared(point, m_position) <= m_radius * m_radius;
+	return interpolatePosition(vector_cast<double>(Vector_2d<Scalar>(previousPositionX[index], previousPositionY[index])),
+		vector_cast<double>(Vector_2d<Scalar>(positionX[index], positionY[index])), interpolation);
 }
 
-void PhysicsBall::calculateForces(const std::vector<PhysicsBall>& otherBalls)
+void showBalls(SDL_Renderer* renderer, SimulationState& state, buttonStates mouseButtons[], Vector_2d<Scalar> mousePosition, double interpolation)
 {
-	m_force = Vector_2d(0.0, 0.0);
-	
-	for (const PhysicsBall& otherBall : otherBalls)
+	bool forceLines = !state.forceX.empty();
+
+	for (std::size_t i = 0; i < state.size(); ++i)
 	{
-		if (&otherBall != this)
+		const ColdParticle& cold = state.cold[i];
+		Vector_2d<double> position = state.getInterpolatedPosition(i, interpolation);
+		Vector_2d<double> velocity = vector_cast<double>(Vector_2d<Scalar>(state.velocityX[i], state.velocityY[i]));
+		SDL_Color color = cold.color;
+
+		SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+		SDL_RenderFillCircle(renderer, position.x, position.y, static_cast<double>(state.radius[i]));
+		if (forceLines)
 		{
-			Vector_2d force;
-			double distSqr = distanceSquared(otherBall.m_position, m_position);
-			double forceValue = otherBall.m_mass * m_mass / distSqr;
+			SDL_SetRenderDrawColor(renderer, 255, 0, 255, 255);
+			SDL_RenderDrawLine(renderer, position.x, position.y, position.x + LINE_SCALE_FORCE * state.forceX[i], position.y + LINE_SCALE_FORCE * state.forceY[i]);
+		}
+		SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+		SDL_RenderDrawLine(renderer, position.x, position.y, position.x + LINE_SCALE_VELOCITY * velocity.x, position.y + LINE_SCALE_VELOCITY * velocity.y);
+		if ((cold.flags & flagPickedUp) && mouseButtons[right].held)
+		{
+			SDL_SetRenderDrawColor(renderer, 128, 128, 255, 255);
+			SDL_RenderDrawLine(renderer, position.x, position.y, static_cast<double>(mousePosition.x), static_cast<double>(mousePosition.y));
+		}
+	}
+}
 
-			//Normalize vector and scale by force value
-			force = forceValue * (otherBall.m_position - m_position) * rsqrt(distSqr);
+//What showBalls() draws as triangles, a batch for every RENDER_CHUNK_BALLS balls built on whichever
+//render job thread gets the chunk. Returns the number of batches filled in.
+std::size_t prepareBalls(JobSystem& jobs, FrameArena& arena, std::vector<VertexBatch>& batches, SimulationState& state, buttonStates mouseButtons[], Vector_2d<Scalar> mousePosition, double interpolation)
+{
+	bool forceLines = !state.forceX.empty();
+	std::size_t chunks = (state.size() + RENDER_CHUNK_BALLS - 1) / RENDER_CHUNK_BALLS;
+	if (batches.size() < chunks)
+		batches.resize(chunks);
 
-			m_force += GRAV * force;
+	jobs.parallelFor(chunks, 1, [&](std::size_t firstChunk, std::size_t lastChunk)
+	{
+		for (std::size_t chunk = firstChunk; chunk < lastChunk; ++chunk)
+		{
+			VertexBatch& batch = batches[chunk];
+			batch.clear();
+			std::size_t end = std::min((chunk + 1) * RENDER_CHUNK_BALLS, state.size());
+			for (std::size_t i = chunk * RENDER_CHUNK_BALLS; i < end; ++i)
+			{
+				const ColdParticle& cold = state.cold[i];
+				Vector_2d<double> position = state.getInterpolatedPosition(i, interpolation);
+				Vector_2d<double> velocity = vector_cast<double>(Vector_2d<Scalar>(state.velocityX[i], state.velocityY[i]));
+
+				batch.addCircle(position, static_cast<double>(state.radius[i]), cold.color);
+				if (forceLines)
+					batch.addLine(position, position + LINE_SCALE_FORCE * Vector_2d<double>(state.forceX[i], state.forceY[i]), SDL_Color(255, 0, 255, 255));
+				batch.addLine(position, position + LINE_SCALE_VELOCITY * velocity, SDL_Color(255, 255, 255, 255));
+				if ((cold.flags & flagPickedUp) && mouseButtons[right].held)
+					batch.addLine(position, vector_cast<double>(mousePosition), SDL_Color(128, 128, 255, 255));
+			}
 		}
+	}, arena);
+
+	return chunks;
+}
+
+//Each batch in one call, in order, so balls overlap the same way as with showBalls()
+void drawBatches(SDL_Renderer* renderer, const std::vector<VertexBatch>& batches, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		const VertexBatch& batch = batches[i];
+		if (!batch.indices.empty())
+			SDL_RenderGeometry(renderer, nullptr, batch.vertices.data(), (int)batch.vertices.size(), batch.indices.data(), (int)batch.indices.size());
 	}
 }
 
-void PhysicsBall::update(std::vector<PhysicsBall>& otherBalls, buttonStates mouseButtons[], Vector_2d mousePosition, PhysicsBall*& p_pickedUpBall, double elapsedTime)
+//One step as a graph of tasks. Every task waits only for the ones whose results it reads, e.g.
+//storing the previous positions overlaps finding the binaries. The step's own data goes in arena,
+//threadArenas are scratch for whichever job thread runs a piece and the broadphase's pairs go in
+//contactLists, one per job thread. The tasks that go through every
+//other ball for each ball are cut by costZones, measured from the step before.
+void stepPhysics(ParticleStore<Scalar>& balls, JobSystem& jobs, FrameArena& arena, FrameArenas& threadArenas, ContactLists& contactLists, integrators integrator, reductionModes reduction, removalPolicies removalPolicy,
+	ReorderSchedule& reorderSchedule, CostZones& costZones, const Grab& grab, double timeStep)
 {
-	if (m_mass > 0.0)
+	std::size_t count = balls.size();
+	FrameVector<int> binaryPartner(count, NO_BALL, arena);
+	Accelerations<Scalar> accelerations(count, arena);
+	Contacts contacts(count, contactLists, arena);
+	TaskGraph graph(arena);
+	const std::uint64_t* costs = costZones.getCostPrefix(count);
+	std::uint32_t* interactions = costZones.measure(count);
+
+	int previousPositions = graph.addFor(count, JOB_MIN_BALLS, [&](std::size_t begin, std::size_t end)
 	{
-		m_velocity += m_force / m_mass * elapsedTime;
-		m_position += m_velocity * elapsedTime;
+		storePreviousPositions(balls, begin, end);
+	});
+
+	int integration;
+	if (wisdomHolman == integrator)
+	{
+		integration = graph.add([&]()
+		{
+			stepWisdomHolman(balls, jobs, threadArenas.get(JobSystem::getThreadIndex()), reduction, timeStep);
+		}, { previousPositions });
+	}
+	else
+	{
+		int strongestPulls = graph.addWeightedFor(count, JOB_MIN_ROWS, costs, [&](std::size_t begin, std::size_t end)
+		{
+			findStrongestPulls(balls, binaryPartner, begin, end);
+		});
+		int binaries = graph.add([&]()
+		{
+			keepBoundBinaries(balls, binaryPartner);
+		}, { strongestPulls });
+		int forces = graph.addWeightedFor(count, JOB_MIN_ROWS, costs, [&](std::size_t begin, std::size_t end)
+		{
+			calculateAccelerations(balls, accelerations, binaryPartner.data(), NO_BALL, begin, end);
+		}, { binaries });
+		integration = graph.addFor(count, JOB_MIN_BALLS, [&](std::size_t begin, std::size_t end)
+		{
+			integrate(balls, accelerations, binaryPartner.data(), timeStep, begin, end);
+		}, { forces, previousPositions });
 	}
 
-	//clamp down the velocity
-	if (distanceSquared(m_velocity) <= 0.001)
-		m_velocity = Vector_2d(0.0, 0.0);
+	//Marking for removal isn't thread safe
+	int wrap = graph.add([&]()
+	{
+		holdGrabbedBall(balls, grab);
+		clampAndWrap(balls);
+	}, { integration });
+	int broadphase = graph.addWeightedFor(count, JOB_MIN_ROWS, costs, [&](std::size_t begin, std::size_t end)
+	{
+		findContacts(balls, contacts, begin, end, JobSystem::getThreadIndex());
+		//Every ball goes through the ones after it, and then the contacts it finds
+		for (std::size_t i = begin; i < end; ++i)
+			interactions[i] = (std::uint32_t)(count - i + contacts.rowSizes[i]);
+	}, { wrap });
+	graph.add([&]()
+	{
+		resolveContacts(balls, contacts);
+	}, { broadphase });
+
+	jobs.run(graph);
+	costZones.measured();
+
+	curves reorder = reorderSchedule.update(balls);
+	balls.compact(jobs, arena, removalPolicy, reorder);
+	if (noCurve != reorder)
+		reorderSchedule.reordered(balls);
+	if (noCurve != reorder || balls.size() != count)
+		costZones.invalidate();
+}
 
-	if (p_pickedUpBall != nullptr)
+
+
+
+//Settings changed with keys on the render thread, the simulation picks them up between steps
+struct SimulationSettings
+{
+	bool operator==(const SimulationSettings&) const = default;
+	//Only the fields that differ between before and after, so a change the simulation made
+	//itself (a scenario's time warp) stays unless the same field is changed again
+	void change(const SimulationSettings& before, const SimulationSettings& after);
+
+	int timeWarp = 1;
+	int physicsRate = PHYSICS_RATE;
+	integrators integrator = euler;
+	reductionModes reduction = fastReduction;
+	removalPolicies removalPolicy = swapRemoval;
+	bool reorder = false; //along a space-filling curve, when the balls have strayed from it
+	curves curve = hilbertCurve;
+	bool costZones = true; //pieces of equal cost instead of equal length
+	bool pipelined = true; //frames are drawn while the next steps run, at the cost of a frame of latency
+	bool forceLines = true; //worked out again for every published state, as expensive as a step
+};
+
+void SimulationSettings::change(const SimulationSettings& before, const SimulationSettings& after)
+{
+	if (before.timeWarp != after.timeWarp)
+		timeWarp = after.timeWarp;
+	if (before.physicsRate != after.physicsRate)
+		physicsRate = after.physicsRate;
+	if (before.integrator != after.integrator)
+		integrator = after.integrator;
+	if (before.reduction != after.reduction)
+		reduction = after.reduction;
+	if (before.removalPolicy != after.removalPolicy)
+		removalPolicy = after.removalPolicy;
+	if (before.reorder != after.reorder)
+		reorder = after.reorder;
+	if (before.curve != after.curve)
+		curve = after.curve;
+	if (before.costZones != after.costZones)
+		costZones = after.costZones;
+	if (before.pipelined != after.pipelined)
+		pipelined = after.pipelined;
+	if (before.forceLines != after.forceLines)
+		forceLines = after.forceLines;
+}
+
+enum commandTypes
+{
+	settingsCommand,
+	spawnCommand, //a small ball at position, for resizeCommand to size
+	resizeCommand, //the last spawned ball, out to position
+	grabCommand, //the ball at position, holding it still if hold
+	dragCommand, //a held ball to position
+	releaseCommand,
+	flingCommand, //the grabbed ball, away from position
+	deleteCommand, //the ball at position
+	bulkSpawnCommand,
+	rewindCommand, //by frames, back is negative
+	carryOnCommand, //from the rewound state
+	scenarioCommand, //starts the scenario number index
+	scenarioEventCommand, //signals the scenario event number index
+	measureCommand, //prints the energy and momentum once
+	max_commandTypes
+};
+
+//Something the input wants done to the simulation. Commands are applied in the order they were
+//sent, between steps, so a step sees the balls either before or after a command and never halfway.
+struct Command
+{
+	commandTypes type;
+	Vector_2d<Scalar> position{ 0, 0 };
+	bool hold = false;
+	int frames = 0;
+	int index = 0;
+	SimulationSettings previousSettings{}; //settingsCommand changes what differs from these to settings
+	SimulationSettings settings{};
+};
+
+enum scenarios
+{
+	orbitScenario,
+	blackHoleScenario,
+	benchmarkScenario,
+	max_scenarios
+};
+const char* scenarioNames[max_scenarios] = { "orbit", "black hole", "benchmark" };
+
+enum scenarioEvents
+{
+	nextEvent, //N
+	max_scenarioEvents
+};
+
+//What scenario scripts can change. They run on the simulation thread between steps.
+struct ScenarioContext
+{
+	ParticleStore<Scalar>& balls;
+	SimulationSettings& settings;
+	JobSystem& jobs;
+	FrameArena& arena; //the tick's
+};
+
+//The old ORBIT_DEMO: a moon on a circular orbit around a planet, with the pair's centre of mass
+//keeping still in the middle of the screen
+Scenario orbitDemo(ScenarioContext context)
+{
+	Vector_2d<Scalar> centre(SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2);
+	double planetMass = massFromRadius(110.0);
+	double moonMass = massFromRadius(30.0);
+	double totalMass = planetMass + moonMass;
+	double distance = ORBIT_DEMO_DISTANCE;
+	double speed = std::sqrt(context.balls.gravity * totalMass / distance);
+
+	Handle planet = context.balls.add(110, SDL_Color(0, 128, 255, 255), centre - Vector_2d<Scalar>(distance * moonMass / totalMass, 0),
+		Vector_2d<Scalar>(0, speed * moonMass / totalMass));
+	Handle moon = context.balls.add(30, SDL_Color(200, 200, 200, 255), centre + Vector_2d<Scalar>(distance * planetMass / totalMass, 0),
+		Vector_2d<Scalar>(0, -speed * planetMass / totalMass));
+	if (!context.balls.isValid(planet) || !context.balls.isValid(moon))
+		co_return;
+	printf("Orbit: N throws in another moon\n");
+
+	co_await WaitForEvent{ nextEvent };
+	if (!context.balls.isValid(planet))
+		co_return;
+	//Going the other way round, further out
+	PhysicsBall<Scalar> planetBall = context.balls.get(planet);
+	double outer = distance * 1.5;
+	double outerSpeed = std::sqrt(context.balls.gravity * planetMass / outer);
+	context.balls.add(20, SDL_Color(255, 200, 100, 255), planetBall.getPosition() - Vector_2d<Scalar>(outer, 0),
+		planetBall.getVelocity() - Vector_2d<Scalar>(0, outerSpeed));
+
+	WaitUntil planetGone{ [context, planet] { return !context.balls.isValid(planet); } };
+	co_await planetGone;
+	printf("Orbit: the planet is gone\n");
+}
+
+//The old BLACK_HOLE: a field of small balls, then something very heavy in the middle of it
+Scenario blackHoleDemo(ScenarioContext context)
+{
+	SpawnDistribution distribution{ Vector_2d<double>{ 0.0, 0.0 }, Vector_2d<double>{ (double)SCREEN_WIDTH, (double)SCREEN_HEIGHT }, 1.0, 3.0, 10.0, Random::mt() };
+	context.balls.addMany(context.jobs, context.arena, BLACK_HOLE_DEMO_BALLS, distribution);
+
+	co_await WaitFor{ BLACK_HOLE_DEMO_DELAY };
+	Handle hole = context.balls.add(BLACK_HOLE_RADIUS, SDL_Color(255, 0, 0, 255), Vector_2d<Scalar>(SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2));
+	if (!context.balls.isValid(hole))
+		co_return;
+	context.balls.get(hole).setMass(BLACK_HOLE_MASS);
+	printf("Black hole: here it comes\n");
+}
+
+//Times BENCHMARK_SECONDS of simulated time with BENCHMARK_BALLS more balls, flat out. The time
+//warp keys still work meanwhile, they change the warp from the benchmark's.
+Scenario benchmark(ScenarioContext context)
+{
+	int timeWarp = context.settings.timeWarp;
+	int benchmarkWarp = std::max(timeWarp, TIME_WARP_UNPACED);
+	context.settings.timeWarp = benchmarkWarp;
+	printf("Benchmark: time warp x%d for %f simulated s\n", benchmarkWarp, BENCHMARK_SECONDS);
+	SpawnDistribution distribution{ Vector_2d<double>{ 0.0, 0.0 }, Vector_2d<double>{ (double)SCREEN_WIDTH, (double)SCREEN_HEIGHT }, 2.0, 5.0, 20.0, Random::mt() };
+	context.balls.addMany(context.jobs, context.arena, BENCHMARK_BALLS, distribution);
+
+	uint64_t startTime = SDL_GetPerformanceCounter();
+	co_await WaitFor{ BENCHMARK_SECONDS };
+	double wallTime = (SDL_GetPerformanceCounter() - startTime) / (double)TICKS_PER_SECOND;
+	printf("Benchmark: %f simulated s with %zu balls in %fs, %f simulated s per wall s\n", BENCHMARK_SECONDS, context.balls.size(), wallTime, BENCHMARK_SECONDS / wallTime);
+
+	//Changed with the keys, that's the one to keep
+	if (context.settings.timeWarp != benchmarkWarp)
 	{
-		if(!(mouseButtons[left].down && mouseButtons[right].down)) //if both are pressed at the same time, do nothing
+		printf("Benchmark: the time warp changed to x%d while it ran, the timing isn't flat out\n", context.settings.timeWarp);
+		co_return;
+	}
+	context.settings.timeWarp = timeWarp;
+	printf("Time warp: x%d\n", timeWarp);
+}
+
+Scenario makeScenario(scenarios scenario, ScenarioContext context)
+{
+	if (blackHoleScenario == scenario)
+		return blackHoleDemo(context);
+	if (benchmarkScenario == scenario)
+		return benchmark(context);
+	return orbitDemo(context);
+}
+
+//Runs the physics on a thread of its own at its own rate, so a slow step doesn't hold up input
+//and drawing, and vsync doesn't hold up the physics. Commands come in through a lock-free queue,
+//finished states go out through a TripleBuffer, so neither side ever waits on the other.
+//With pipelining off the two go in lockstep instead: every frame waits for a tick of its own,
+//which picks up the frame's commands, and draws its result straight away.
+class Simulation
+{
+public:
+	Simulation();
+	~Simulation();
+	Simulation(const Simulation&) = delete;
+	Simulation& operator=(const Simulation&) = delete;
+
+	//Any thread, never waits. Returns false if the queue is full and the command was dropped.
+	bool send(const Command& command) { return m_commands.push(command); }
+	//Render thread side. requestFrame() every frame, without pipelining waitForFrame() then
+	//waits for the tick that picked up everything sent before the request.
+	std::uint64_t requestFrame();
+	void waitForFrame(std::uint64_t frame);
+	SimulationState& getLatestState();
+	void stop();
+private:
+	void run();
+	//Both return true if anything changed that should be published without a step
+	bool applyCommands();
+	bool apply(const Command& command);
+	void step(double timeStep);
+	void publish(ParticleStore<Scalar>& balls, double stepLength);
+	void report(double wallTime, double simulatedTime, int ticks);
+	void reportConserved();
+
+	std::thread m_thread;
+	std::atomic<bool> m_quit{ false };
+
+	CommandQueue<Command> m_commands;
+	TripleBuffer<SimulationState> m_states;
+	std::atomic<std::uint64_t> m_requestedFrame{ 0 };
+	std::atomic<std::uint64_t> m_finishedFrame{ 0 }; //the last request a tick started after
+
+	//Everything from here on belongs to the simulation thread
+	SimulationSettings m_settings;
+	ParticleStore<Scalar> m_balls;
+	FrameArenas m_frameArenas;
+	ContactLists m_contactLists;
+	JobSystem m_jobs;
+	ReorderSchedule m_reorderSchedule;
+	CostZones m_costZones;
+	std::size_t m_placedCount = 0; //balls when they were last placed on the NUMA nodes
+	Grab m_grab;
+	Handle m_spawnedBall; //the ball resizeCommand sizes
+	double m_simulatedTime = 0.0;
+	ScenarioRunner m_scenarios; //after the balls, the scripts hold on to them
+
+	//Rewinding: left and right arrows move through the history, enter carries on from there
+	History<Scalar> m_history;
+	double m_historyTime = 0.0; //simulated since the last recorded frame
+	bool m_rewinding = false;
+	std::size_t m_rewindFrame = 0;
+	ParticleStore<Scalar> m_rewindPreview;
+
+	std::uint64_t m_reportHeapAllocations = 0;
+};
+
+Simulation::Simulation()
+	: m_commands(COMMAND_QUEUE_SIZE), m_frameArenas(SDL_GetCPUCount()), m_contactLists(m_frameArenas.getThreadCount()), m_jobs(m_frameArenas.getThreadCount(), NUMA_AWARE), m_history(HISTORY_SECONDS)
+{
+	m_balls.setBudget(PARTICLE_BUDGET, rejectWhenFull);
+	if (BALLS_COUNT > 0)
+	{
+		SpawnDistribution distribution{ Vector_2d<double>{ 50.0, 50.0 }, Vector_2d<double>{ SCREEN_WIDTH - 50.0, SCREEN_HEIGHT - 50.0 }, 25.0, 50.0, 0.0, Random::mt() };
+		m_balls.addMany(m_jobs, m_frameArenas.get(0), BALLS_COUNT, distribution);
+	}
+
+	//Last, everything it uses has to exist first
+	m_thread = std::thread(&Simulation::run, this);
+}
+
+Simulation::~Simulation()
+{
+	stop();
+}
+
+void Simulation::stop()
+{
+	m_quit = true;
+	//In case it's waiting for a frame
+	++m_requestedFrame;
+	m_requestedFrame.notify_all();
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+std::uint64_t Simulation::requestFrame()
+{
+	std::uint64_t frame = ++m_requestedFrame;
+	m_requestedFrame.notify_all();
+	return frame;
+}
+
+void Simulation::waitForFrame(std::uint64_t frame)
+{
+	//Doesn't depend on the simulation having switched to lockstep yet, every tick finishes a frame
+	std::uint64_t finished = m_finishedFrame.load();
+	while (finished < frame)
+	{
+		m_finishedFrame.wait(finished);
+		finished = m_finishedFrame.load();
+	}
+}
+
+SimulationState& Simulation::getLatestState()
+{
+	m_states.update();
+	return m_states.getReadBuffer();
+}
+
+void Simulation::run()
+{
+	int physicsRate = PHYSICS_RATE;
+	FramePacer pacer(physicsRate);
+	double physicsAccumulator = 0.0;
+	double elapsedTime = 0.0;
+
+	std::uint64_t reportStartTime = SDL_GetPerformanceCounter();
+	double reportSimulatedTime = 0.0;
+	int reportTicks = 0;
+	m_reportHeapAllocations = g_heapAllocations;
+	m_jobs.pinCallingThread();
+	publish(m_balls, 1.0 / physicsRate);
+
+	while (!m_quit)
+	{
+		uint64_t startTime = SDL_GetPerformanceCounter();
+		//Before the commands, everything sent before this request is already queued
+		std::uint64_t frame = m_requestedFrame.load();
+		bool changed = applyCommands();
+		//Scripts wait while the history is shown, like the simulation
+		if (!m_rewinding)
+			changed |= m_scenarios.update(m_simulatedTime);
+		const SimulationSettings& settings = m_settings;
+		if (settings.physicsRate != physicsRate)
 		{
-			//Picking the ball up
-			if (mouseButtons[left].down)
-			{
-				p_pickedUpBall->m_force = Vector_2d(0.0, 0.0);
-				p_pickedUpBall->m_velocity = Vector_2d(0.0, 0.0);
-			}
-			if (mouseButtons[left].held)
-			{
-				p_pickedUpBall->m_force = Vector_2d(0.0, 0.0);
-				p_pickedUpBall->m_velocity = Vector_2d(0.0, 0.0);
-				p_pickedUpBall->m_position = mousePosition;
-			}
-			if (mouseButtons[left].up)
+			physicsRate = settings.physicsRate;
+			pacer.setFps(physicsRate);
+		}
+
+		//New balls were first written by whoever spawned them, and the shares of the balls each
+		//node works on move with the count
+		if (m_jobs.isNumaAware() && (m_balls.size() > m_placedCount * NUMA_PLACE_FACTOR || m_balls.size() * NUMA_PLACE_FACTOR < m_placedCount))
+		{
+			m_balls.place(m_jobs, m_frameArenas.get(0));
+			m_placedCount = m_balls.size();
+		}
+
+		//Past TIME_WARP_UNPACED the simulation stops keeping to real time and runs as fast as it can
+		bool paced = settings.timeWarp < TIME_WARP_UNPACED;
+		double physicsTimeStep = 1.0 / physicsRate;
+		int steps = settings.timeWarp;
+		if (paced)
+		{
+			physicsAccumulator += elapsedTime * settings.timeWarp;
+			steps = physicsAccumulator / physicsTimeStep;
+			if (steps > settings.timeWarp * MAX_PHYSICS_STEPS_PER_FRAME)
 			{
-				p_pickedUpBall = nullptr;
+				steps = settings.timeWarp * MAX_PHYSICS_STEPS_PER_FRAME;
+				physicsAccumulator = steps * physicsTimeStep;
 			}
+			physicsAccumulator -= steps * physicsTimeStep;
+		}
+		else
+		{
+			physicsAccumulator = 0.0;
+		}
+		if (m_rewinding)
+		{
+			//The simulation waits while the history is shown
+			steps = 0;
+			physicsAccumulator = 0.0;
+		}
 
-			//Giving the ball velocity
-			if (mouseButtons[right].up)
+		for (int i = 0; i < steps; ++i)
+			step(physicsTimeStep);
+		reportSimulatedTime += steps * physicsTimeStep;
+
+		//Nothing new to draw after a tick without steps, publishing again would restart the interpolation
+		if (m_rewinding)
+		{
+			if (changed)
 			{
-				p_pickedUpBall->m_velocity = (p_pickedUpBall->m_position - mousePosition);
-				p_pickedUpBall = nullptr;
+				m_history.restore(m_rewindFrame, m_rewindPreview, m_jobs, m_frameArenas.get(0));
+				publish(m_rewindPreview, physicsTimeStep / settings.timeWarp);
 			}
 		}
+		else if (steps > 0 || changed)
+		{
+			publish(m_balls, physicsTimeStep / settings.timeWarp);
+		}
+
+		m_frameArenas.reset();
+		++reportTicks;
+
+		m_finishedFrame = frame;
+		m_finishedFrame.notify_all();
+
+		if (!settings.pipelined && !m_quit)
+		{
+			//The next tick starts when the render thread asks for its next frame
+			m_requestedFrame.wait(frame);
+			pacer.resync();
+			elapsedTime = (SDL_GetPerformanceCounter() - startTime) / (double)TICKS_PER_SECOND;
+		}
+		else if (paced)
+		{
+			elapsedTime = pacer.waitForNextFrame();
+		}
+		else
+		{
+			pacer.resync();
+			elapsedTime = (SDL_GetPerformanceCounter() - startTime) / (double)TICKS_PER_SECOND;
+		}
+
+		uint64_t endTime = SDL_GetPerformanceCounter();
+		double reportWallTime = (endTime - reportStartTime) / (double)TICKS_PER_SECOND;
+		if (reportWallTime >= 1.0)
+		{
+			report(reportWallTime, reportSimulatedTime, reportTicks);
+			reportStartTime = endTime;
+			reportSimulatedTime = 0.0;
+			reportTicks = 0;
+		}
+	}
+}
+
+bool Simulation::applyCommands()
+{
+	bool changed = false;
+	Command command;
+	while (m_commands.pop(command))
+		changed |= apply(command);
+	return changed;
+}
+
+bool Simulation::apply(const Command& command)
+{
+	if (settingsCommand == command.type)
+	{
+		SimulationSettings previous = m_settings;
+		m_settings.change(command.previousSettings, command.settings);
+		if (m_settings.reorder != previous.reorder || m_settings.curve != previous.curve)
+		{
+			m_reorderSchedule.enabled = m_settings.reorder;
+			m_reorderSchedule.curve = m_settings.curve;
+			m_reorderSchedule.stepsSinceReorder = REORDER_INTERVAL; //reorder straight away
+		}
+		m_costZones.enabled = m_settings.costZones;
+		return false;
 	}
 
-	//border collisions
-	/*if (m_position.x - m_radius < 0 || m_position.x + m_radius > SCREEN_WIDTH)
+	if (spawnCommand == command.type)
 	{
-		m_position.x -= m_velocity.x;
-		m_velocity.x = -m_velocity.x;
+		double radius = 1.0;
+		SDL_Color color = SDL_Color(Random::get(0, 255), Random::get(0, 255), Random::get(0, 255), 255);
+
+		m_spawnedBall = m_balls.add(radius, color, command.position);
+		if (!m_balls.isValid(m_spawnedBall))
+			printf("Particle budget of %zu balls is full\n", m_balls.getBudget());
+		return true;
 	}
-	if (m_position.y - m_radius < 0 || m_position.y + m_radius > SCREEN_HEIGHT)
+	if (resizeCommand == command.type)
 	{
-		m_position.y -= m_velocity.y;
-		m_velocity.y = -m_velocity.y;
-	}*/
+		if (!m_balls.isValid(m_spawnedBall))
+			return false;
 
-	//wraping the ball
-	if (m_position.x < 0)
+		PhysicsBall<Scalar> spawned = m_balls.get(m_spawnedBall);
+		Scalar radius = length(command.position - spawned.getPosition());
+		if (radius < 1.0)
+			radius = 1.0;
+
+		spawned.setRadius(radius);
+		return true;
+	}
+
+	if (grabCommand == command.type)
 	{
-		m_position.x = SCREEN_WIDTH;
+		Handle ball = findBallAt(m_balls, command.position);
+		if (!m_balls.isValid(ball))
+			return false;
+
+		setPickedUpBall(m_balls, m_grab.ball, ball);
+		m_grab.holding = command.hold;
+		m_grab.target = command.position;
+		if (m_grab.holding)
+			m_balls.get(ball).setVelocity(Vector_2d<Scalar>());
+		return true;
 	}
-	if (m_position.x > SCREEN_WIDTH)
+	if (dragCommand == command.type)
 	{
-		m_position.x = 0;
+		//The held ball follows at the next step
+		m_grab.target = command.position;
+		return false;
 	}
-	if (m_position.y < 0)
+	if (releaseCommand == command.type || flingCommand == command.type)
 	{
-		m_position.y = SCREEN_HEIGHT;
+		if (!m_balls.isValid(m_grab.ball))
+			return false;
+
+		if (flingCommand == command.type)
+		{
+			PhysicsBall<Scalar> grabbed = m_balls.get(m_grab.ball);
+			grabbed.setVelocity(grabbed.getPosition() - command.position);
+		}
+		setPickedUpBall(m_balls, m_grab.ball, Handle());
+		m_grab.holding = false;
+		return true;
 	}
-	if (m_position.y > SCREEN_HEIGHT)
+
+	if (deleteCommand == command.type)
+	{
+		Handle ball = findBallAt(m_balls, command.position);
+		if (m_balls.isValid(ball))
+			m_balls.markForRemoval(ball);
+		return false;
+	}
+	if (bulkSpawnCommand == command.type)
+	{
+		uint64_t spawnStartTime = SDL_GetPerformanceCounter();
+		SpawnDistribution distribution{ Vector_2d<double>{ 0.0, 0.0 }, Vector_2d<double>{ (double)SCREEN_WIDTH, (double)SCREEN_HEIGHT }, 2.0, 5.0, 20.0, Random::mt() };
+		std::size_t spawned = m_balls.addMany(m_jobs, m_frameArenas.get(0), BULK_SPAWN_COUNT, distribution);
+		printf("Spawned %zu balls in %fms, %zu in total\n", spawned,
+			(SDL_GetPerformanceCounter() - spawnStartTime) * 1000.0 / TICKS_PER_SECOND, m_balls.size());
+		return true;
+	}
+
+	if (rewindCommand == command.type)
+	{
+		//Forwards only moves back towards the present once rewinding
+		if (m_history.empty() || (command.frames > 0 && !m_rewinding))
+			return false;
+
+		if (!m_rewinding)
+		{
+			m_rewinding = true;
+			m_rewindFrame = m_history.getNewestFrame();
+		}
+		for (int frames = command.frames; frames < 0; ++frames)
+		{
+			if (m_rewindFrame > m_history.getOldestFrame())
+				--m_rewindFrame;
+		}
+		for (int frames = command.frames; frames > 0; --frames)
+		{
+			if (m_rewindFrame < m_history.getNewestFrame())
+				++m_rewindFrame;
+		}
+		printf("Rewound %fs\n", m_history.getTimeBetween(m_rewindFrame, m_history.getNewestFrame()));
+		return true;
+	}
+	if (carryOnCommand == command.type)
+	{
+		if (!m_rewinding)
+			return false;
+
+		m_history.restore(m_rewindFrame, m_balls, m_jobs, m_frameArenas.get(0));
+		m_history.truncate(m_rewindFrame);
+		m_historyTime = 0.0;
+		m_rewinding = false;
+		printf("Carrying on from the rewound state\n");
+		return true;
+	}
+
+	if (scenarioCommand == command.type)
+	{
+		if (command.index < 0 || command.index >= max_scenarios)
+			return false;
+
+		//Runs up to its first wait straight after the commands
+		m_scenarios.start(makeScenario(static_cast<scenarios>(command.index), ScenarioContext{ m_balls, m_settings, m_jobs, m_frameArenas.get(0) }));
+		printf("Scenario: %s\n", scenarioNames[command.index]);
+		return false;
+	}
+	if (scenarioEventCommand == command.type)
+	{
+		m_scenarios.signal(command.index);
+		return false;
+	}
+	if (measureCommand == command.type)
+	{
+		reportConserved();
+		return false;
+	}
+
+	return false;
+}
+
+void Simulation::step(double timeStep)
+{
+	const SimulationSettings& settings = m_settings;
+	stepPhysics(m_balls, m_jobs, m_frameArenas.get(0), m_frameArenas, m_contactLists, settings.integrator, settings.reduction, settings.removalPolicy, m_reorderSchedule, m_costZones, m_grab, timeStep);
+
+	m_historyTime += timeStep;
+	if (m_historyTime >= 1.0 / HISTORY_RATE)
+	{
+		m_history.record(m_balls, m_historyTime);
+		m_historyTime = 0.0;
+	}
+
+	m_simulatedTime += timeStep;
+	m_scenarios.update(m_simulatedTime);
+}
+
+void Simulation::publish(ParticleStore<Scalar>& balls, double stepLength)
+{
+	SimulationState& state = m_states.getWriteBuffer();
+	state.copy(balls);
+
+	//The physics doesn't keep forces between steps, and working them out again costs as much as
+	//a step, so only when they're drawn
+	state.forceX.clear();
+	state.forceY.clear();
+	if (m_settings.forceLines && m_settings.timeWarp < TIME_WARP_SKIP_PRESENT)
 	{
-		m_position.y = 0;
+		FrameArena& arena = m_frameArenas.get(0);
+		Accelerations<Scalar> accelerations(balls.size(), arena);
+		state.forceX.resize(balls.size());
+		state.forceY.resize(balls.size());
+		m_jobs.parallelFor(balls.size(), JOB_MIN_ROWS, [&](std::size_t begin, std::size_t end)
+		{
+			calculateAccelerations(balls, accelerations, nullptr, NO_BALL, begin, end);
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				state.forceX[i] = static_cast<double>(balls.mass[i]) * static_cast<double>(accelerations.x[i]);
+				state.forceY[i] = static_cast<double>(balls.mass[i]) * static_cast<double>(accelerations.y[i]);
+			}
+		}, arena);
 	}
 
-	//ball collisions
-	for (PhysicsBall& otherBall : otherBalls)
+	state.stepLength = stepLength;
+	state.timeWarp = m_settings.timeWarp;
+	state.publishTime = SDL_GetPerformanceCounter();
+	m_states.publish();
+}
+
+void Simulation::report(double wallTime, double simulatedTime, int ticks)
+{
+	printf("Time warp x%d: %f simulated s per wall s\n", m_settings.timeWarp, simulatedTime / wallTime);
+
+	std::uint64_t heapAllocations = g_heapAllocations;
+	printf("Memory: %f heap allocations per simulation tick, frame arenas %zu KB, largest tick %zu KB\n",
+		(heapAllocations - m_reportHeapAllocations) / (double)ticks, m_frameArenas.getCapacity() / 1024, m_frameArenas.get(0).getHighWater() / 1024);
+	m_reportHeapAllocations = heapAllocations;
+	std::uint64_t jobsRun, jobsStolen;
+	m_jobs.getStatistics(jobsRun, jobsStolen);
+	printf("Jobs: %f pieces per tick on %d threads, %f%% stolen\n", jobsRun / (double)ticks, m_jobs.getThreadCount(), jobsStolen * 100.0 / std::max<std::uint64_t>(jobsRun, 1));
+	if (m_jobs.isNumaAware())
 	{
-		if (&otherBall != this && checkCollision(otherBall))
+		//Elements of work stand in for memory traffic, there's no portable way to count bytes per node
+		std::uint64_t nodeElements[64] = {}, nodeRemoteElements[64] = {}, totalElements = 0;
+		int nodeCount = std::min(m_jobs.getNodeCount(), 64);
+		for (int node = 0; node < nodeCount; ++node)
 		{
-			//Normal collisions
-			Vector_2d normal = getVectorFromPositions(otherBall.m_position, m_position);
+			m_jobs.getNodeTraffic(node, nodeElements[node], nodeRemoteElements[node]);
+			totalElements += nodeElements[node];
+		}
+		for (int node = 0; node < nodeCount; ++node)
+		{
+			printf("NUMA node %d: %f%% of the work, %f%% of it on another node's balls\n", node,
+				nodeElements[node] * 100.0 / std::max<std::uint64_t>(totalElements, 1), nodeRemoteElements[node] * 100.0 / std::max<std::uint64_t>(nodeElements[node], 1));
+		}
+	}
 
-			Vector_2d displacement = normalizeVector(normal) * (m_radius + otherBall.m_radius - length(normal));
-			m_position += displacement / 2;
-			otherBall.m_position -= displacement / 2;
+	//Everything is counted at capacity, that's what the process actually holds
+	ParticleMemory particleMemory = m_balls.getMemoryUsage();
+	double perBall = 1.0 / std::max<std::size_t>(m_balls.size(), 1);
+	printf("Bytes per ball: particles %.1f (hot %.1f, cold %.1f, handles %.1f), per-step scratch %.1f; %zu of %zu balls, %zu KB total\n",
+		(particleMemory.hot + particleMemory.cold + particleMemory.handles) * perBall, particleMemory.hot * perBall, particleMemory.cold * perBall,
+		particleMemory.handles * perBall, m_frameArenas.get(0).getHighWater() * perBall, m_balls.size(), m_balls.getBudget(),
+		(particleMemory.hot + particleMemory.cold + particleMemory.handles + m_frameArenas.getCapacity()) / 1024);
+	if (m_reorderSchedule.enabled)
+	{
+		printf("Locality: %f px between neighbours in memory, %f after the last reorder %d steps ago\n",
+			m_reorderSchedule.locality, m_reorderSchedule.sortedLocality, m_reorderSchedule.stepsSinceReorder);
+	}
+	if (!m_history.empty())
+	{
+		printf("History: %fs in %zu KB\n", m_history.getTimeBetween(m_history.getOldestFrame(), m_history.getNewestFrame()), m_history.getMemoryUsage() / 1024);
+	}
+}
 
-			normal = normalizeVector(normal);
-			Vector_2d tangent = getPerpendicularVector(normal);
+void Simulation::reportConserved()
+{
+	if (m_balls.empty())
+		return;
+
+	//As expensive as a step, so only when asked for rather than in every report
+	uint64_t measureStartTime = SDL_GetPerformanceCounter();
+	Conserved conserved = measureConserved(m_balls, m_jobs, m_frameArenas.get(0), m_settings.reduction);
+	double energy = conserved.kineticEnergy + conserved.potentialEnergy;
+	printf("Energy: kinetic %e, potential %e, total %e; momentum %e %e; measured in %fms\n",
+		conserved.kineticEnergy, conserved.potentialEnergy, energy, conserved.momentum.x, conserved.momentum.y,
+		(SDL_GetPerformanceCounter() - measureStartTime) * 1000.0 / TICKS_PER_SECOND);
+}
 
-			Vector_2d normalVelocity = projectVector(m_velocity, normal);
-			Vector_2d tangentialVelocity = projectVector(m_velocity, tangent);
 
-			Vector_2d otherNormalVelocity = projectVector(otherBall.m_velocity, normal);
-			Vector_2d otherTangentialVelocity = projectVector(otherBall.m_velocity, tangent);
 
-	
-			m_velocity = tangentialVelocity + ((m_mass - otherBall.m_mass) * normalVelocity + 2 * otherBall.m_mass * otherNormalVelocity) / (m_mass + otherBall.m_mass);
-			otherBall.m_velocity = otherTangentialVelocity + RESTITUTION * (2 * m_mass * normalVelocity + (otherBall.m_mass - m_mass) * otherNormalVelocity) / (m_mass + otherBall.m_mass);
 
-			m_velocity *= RESTITUTION;
-			otherBall.m_velocity *= RESTITUTION;
+//One run of an ensemble, a scene with its own seed and constants
+struct EnsembleRun
+{
+	int index = 0;
+	std::uint64_t seed = 0;
+	ParticleStore<Scalar> balls;
+	FrameArena arena{ ENSEMBLE_FRAME_ARENA_SIZE }; //the run's steps, grows to what one needs
+	ContactLists contactLists;
+	ReorderSchedule reorderSchedule;
+	CostZones costZones;
+	int stepsLeft = 0;
+	bool reported = false;
+	Conserved start;
+	Conserved end;
+	std::uint64_t endHash = 0; //hashState at the end
+};
 
-			/*
-			//Wonky collisions 
-			
-			double dist = std::sqrt(distanceSquared(m_position, otherBall.m_position));
+//Many short runs of the same scene in one process without a window, with different seeds and a
+//grid of gravity and restitution values. The runs are stepped side by side on one job system: each
+//run's step is a task graph run from inside a piece of a task over the runs, so a thread waiting on
+//one run's pieces helps with other runs' and every core stays busy even though a single small run
+//couldn't keep them all going. Each run's summary is printed as a CSV line as soon as it finishes.
+class Ensemble
+{
+public:
+	//Run i's seed is seed + i, the same seed gives the same runs on any number of threads
+	Ensemble(int runCount, std::uint64_t seed, int threadCount);
+	Ensemble(const Ensemble&) = delete;
+	Ensemble& operator=(const Ensemble&) = delete;
 
-			double nx = (otherBall.m_position.x - m_position.x) / dist;
-			double ny = (otherBall.m_position.y - m_position.y) / dist;
+	//Returns a hash of every run's final state, the same seed has to give the same hash
+	std::uint64_t run();
+private:
+	//Up to ENSEMBLE_STEPS_PER_TICK steps of one run, from a job thread
+	void advance(EnsembleRun& run);
 
-			double tx = -ny;
-			double ty = nx;
+	FrameArenas m_threadArenas;
+	JobSystem m_jobs;
+	std::uint64_t m_seed;
+	std::vector<EnsembleRun> m_runs;
+};
 
-			double kx = (b1.m_velocity.x - b2.m_velocity.x);
-			double ky = (b1.m_velocity.y - b2.m_velocity.y);
-			double p = 2.0 * (nx * kx + ny * ky) / (b1.m_mass + b2.m_mass);
-			b1.m_velocity.x = b1.m_velocity.x - p * b2.m_mass * nx;
-			b1.m_velocity.y = b1.m_velocity.y - p * b2.m_mass * ny;
-			b2.m_velocity.x = b2.m_velocity.x + p * b1.m_mass * nx;
-			b2.m_velocity.y = b2.m_velocity.y + p * b1.m_mass * ny;
-			*/
+Ensemble::Ensemble(int runCount, std::uint64_t seed, int threadCount)
+	: m_threadArenas(threadCount), m_jobs(m_threadArenas.getThreadCount(), NUMA_AWARE), m_seed(seed), m_runs(std::max(runCount, 1))
+{
+	//Gravity along one side of the grid, restitution along the other
+	int side = (int)std::ceil(std::sqrt((double)m_runs.size()));
+	for (int i = 0; i < (int)m_runs.size(); ++i)
+	{
+		EnsembleRun& run = m_runs[i];
+		run.index = i;
+		run.seed = seed + i;
+		run.contactLists = ContactLists(m_jobs.getThreadCount());
+		run.balls.gravity = ENSEMBLE_GRAV_MIN + (ENSEMBLE_GRAV_MAX - ENSEMBLE_GRAV_MIN) * (i % side) / std::max(side - 1, 1);
+		run.balls.restitution = ENSEMBLE_RESTITUTION_MIN + (ENSEMBLE_RESTITUTION_MAX - ENSEMBLE_RESTITUTION_MIN) * (i / side % side) / std::max(side - 1, 1);
+		run.balls.setBudget(ENSEMBLE_BALLS, rejectWhenFull);
+
+		SpawnDistribution distribution{ Vector_2d<double>{ 0.0, 0.0 }, Vector_2d<double>{ (double)SCREEN_WIDTH, (double)SCREEN_HEIGHT }, 2.0, 5.0, 20.0, run.seed };
+		run.balls.addMany(m_jobs, run.arena, ENSEMBLE_BALLS, distribution);
+		run.stepsLeft = ENSEMBLE_STEPS;
+	}
+}
+
+std::uint64_t Ensemble::run()
+{
+	fprintf(stderr, "Ensemble: %zu runs from base seed %llu on %d threads, --ensemble %zu %llu repeats them\n", m_runs.size(), (unsigned long long)m_seed,
+		m_jobs.getThreadCount(), m_runs.size(), (unsigned long long)m_seed);
+	printf("run,seed,gravity,restitution,balls,steps,energy_start,energy_end,energy_drift,momentum_start_x,momentum_start_y,momentum_end_x,momentum_end_y,state_hash\n");
+	uint64_t startTime = SDL_GetPerformanceCounter();
 
+	bool finished = false;
+	while (!finished)
+	{
+		m_jobs.parallelFor(m_runs.size(), 1, [&](std::size_t begin, std::size_t end)
+		{
+			for (std::size_t i = begin; i < end; ++i)
+				advance(m_runs[i]);
+		}, m_threadArenas.get(0));
+		m_threadArenas.reset();
+
+		//In run order, on this thread, so the lines never interleave
+		finished = true;
+		for (EnsembleRun& run : m_runs)
+		{
+			if (run.stepsLeft > 0)
+			{
+				finished = false;
+				continue;
+			}
+			if (run.reported)
+				continue;
+
+			double startEnergy = run.start.kineticEnergy + run.start.potentialEnergy;
+			double endEnergy = run.end.kineticEnergy + run.end.potentialEnergy;
+			printf("%d,%llu,%f,%f,%zu,%d,%e,%e,%e,%e,%e,%e,%e,%016llx\n", run.index, (unsigned long long)run.seed, run.balls.gravity, run.balls.restitution,
+				run.balls.size(), ENSEMBLE_STEPS, startEnergy, endEnergy, (endEnergy - startEnergy) / std::max(std::abs(startEnergy), 1e-300),
+				run.start.momentum.x, run.start.momentum.y, run.end.momentum.x, run.end.momentum.y, (unsigned long long)run.endHash);
+			run.reported = true;
 		}
+		fflush(stdout);
 	}
+
+	double seconds = (SDL_GetPerformanceCounter() - startTime) / (double)TICKS_PER_SECOND;
+	double ballSteps = (double)m_runs.size() * ENSEMBLE_BALLS * ENSEMBLE_STEPS;
+	std::uint64_t jobsRun, jobsStolen;
+	m_jobs.getStatistics(jobsRun, jobsStolen);
+	fprintf(stderr, "Ensemble: %zu runs in %fs, %f million ball steps per second on %d threads, %f%% of %llu pieces stolen\n", m_runs.size(), seconds,
+		ballSteps / seconds / 1e6, m_jobs.getThreadCount(), jobsStolen * 100.0 / std::max<std::uint64_t>(jobsRun, 1), (unsigned long long)jobsRun);
+
+	//In run order, so it doesn't matter which run finished first
+	std::uint64_t hash = 14695981039346656037ull;
+	for (EnsembleRun& run : m_runs)
+		hash = (hash ^ run.endHash) * 1099511628211ull;
+	fprintf(stderr, "Ensemble: state hash %016llx\n", (unsigned long long)hash);
+	return hash;
 }
 
-void PhysicsBall::show(SDL_Renderer* renderer, buttonStates mouseButtons[], Vector_2d mousePosition, PhysicsBall*& p_pickedUpBall)
+void Ensemble::advance(EnsembleRun& run)
 {
-	SDL_SetRenderDrawColor(renderer, m_color.r, m_color.g, m_color.b, m_color.a);
-	SDL_RenderFillCircle(renderer, m_position.x, m_position.y, m_radius);
-	SDL_SetRenderDrawColor(renderer, 255, 0, 255, 255);
-	SDL_RenderDrawLine(renderer, m_position.x, m_position.y, m_position.x + LINE_SCALE_FORCE * m_force.x, m_position.y + LINE_SCALE_FORCE * m_force.y);
-	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-	SDL_RenderDrawLine(renderer, m_position.x, m_position.y, m_position.x + LINE_SCALE_VELOCITY * m_velocity.x, m_position.y + LINE_SCALE_VELOCITY * m_velocity.y);
-	if (this == p_pickedUpBall && mouseButtons[right].held)
+	if (run.stepsLeft <= 0)
+		return;
+
+	//Deterministic sums, so a run comes out the same however the threads were shared out
+	if (ENSEMBLE_STEPS == run.stepsLeft)
+		run.start = measureConserved(run.balls, m_jobs, run.arena, deterministicReduction);
+
+	for (int i = 0; i < ENSEMBLE_STEPS_PER_TICK && run.stepsLeft > 0; ++i)
 	{
-		SDL_SetRenderDrawColor(renderer, 128, 128, 255, 255);
-		SDL_RenderDrawLine(renderer, m_position.x, m_position.y, mousePosition.x, mousePosition.y);
+		stepPhysics(run.balls, m_jobs, run.arena, m_threadArenas, run.contactLists, euler, deterministicReduction, swapRemoval, run.reorderSchedule, run.costZones, Grab(), 1.0 / PHYSICS_RATE);
+		run.arena.reset();
+		--run.stepsLeft;
+	}
+
+	if (0 == run.stepsLeft)
+	{
+		run.end = measureConserved(run.balls, m_jobs, run.arena, deterministicReduction);
+		run.endHash = hashState(run.balls);
+		run.arena.reset();
 	}
 }
 
@@ -607,6 +1587,37 @@ void PhysicsBall::show(SDL_Renderer* renderer, buttonStates mouseButtons[], Vect
 
 int main(int argc, char** argv)
 {
+	//--ensemble [runs] [seed] [threads] runs the ensemble instead of the window, the summaries go
+	//to stdout. Without a seed it picks a random one, without a thread count it uses every core.
+	if (argc >= 2 && std::string(argv[1]) == "--ensemble")
+	{
+		int runs = argc >= 3 ? std::atoi(argv[2]) : ENSEMBLE_RUNS;
+		std::uint64_t seed = argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : (std::uint64_t)Random::mt();
+		int threads = argc >= 5 ? std::max(std::atoi(argv[4]), 1) : SDL_GetCPUCount();
+		Ensemble ensemble(runs, seed, threads);
+		ensemble.run();
+		return 0;
+	}
+
+	//--check-determinism [runs] [seed] runs the same ensemble on 1 thread and on every core (at
+	//least 2) and fails if the final states differ in a single bit. Both print their summaries.
+	if (argc >= 2 && std::string(argv[1]) == "--check-determinism")
+	{
+		int runs = argc >= 3 ? std::atoi(argv[2]) : ENSEMBLE_CHECK_RUNS;
+		std::uint64_t seed = argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : (std::uint64_t)Random::mt();
+		int threads = std::max(SDL_GetCPUCount(), 2);
+		std::uint64_t oneThread = Ensemble(runs, seed, 1).run();
+		std::uint64_t allThreads = Ensemble(runs, seed, threads).run();
+		if (oneThread != allThreads)
+		{
+			fprintf(stderr, "Determinism: 1 thread and %d threads came out different, %016llx and %016llx\n", threads,
+				(unsigned long long)oneThread, (unsigned long long)allThreads);
+			return 1;
+		}
+		fprintf(stderr, "Determinism: 1 thread and %d threads came out the same bit for bit, %016llx\n", threads, (unsigned long long)oneThread);
+		return 0;
+	}
+
 	if (!init())
 	{
 		printf("Couldn't initialize!\n");
@@ -619,36 +1630,40 @@ int main(int argc, char** argv)
 		return 1;
 	}
 
+	printf("Physics runs in %s\n", SCALAR_NAME);
+
 	bool quit = false;
 	SDL_Event event;
-	double deltaTime = 0.0;
-	double elapsedTime = 0.0;
-	double realDeltaTime = 0.0;
-	double realElapsedTime = 0.0;
-
-	Vector_2d mousePosition{ 0.0, 0.0 };
-	buttonStates mouseButtons[max_mouseButtons];
-	buttonStates spacebar;
-	PhysicsBall* p_pickedUpBall = nullptr;
 
-	std::vector<PhysicsBall> balls;
-
-	/*for (int i = 0; i < BALLS_COUNT; ++i)
+	//This thread only handles input and draws, the physics runs on the simulation's thread and
+	//everything the input does goes over to it as commands
+	Simulation simulation;
+	SimulationSettings settings;
+	SimulationSettings sentSettings;
+	int publishedTimeWarp = settings.timeWarp; //in the last state, the simulation can change it itself
+	buttonStates mouseButtons[max_mouseButtons]; //held is kept up to date for drawing
+	bool spacebarHeld = false;
+	Vector_2d<Scalar> mousePosition{ 0, 0 };
+	//Building the frame's triangles has job threads of its own, the simulation's are busy stepping
+	FrameArenas renderArenas(std::min(RENDER_THREADS, SDL_GetCPUCount()));
+	JobSystem renderJobs(renderArenas.getThreadCount());
+	std::vector<VertexBatch> batches;
+	bool batchedDrawing = true;
+	auto send = [&simulation](const Command& command)
 	{
-		double radius = Random::get(25, 50);
-		if (i == 0)
-			radius = 25;
-		if (i == 1)
-			radius = 100;
-
-		SDL_Color color = SDL_Color(Random::get(0, 255), Random::get(0, 255), Random::get(0, 255), 255);
+		bool sent = simulation.send(command);
+		if (!sent)
+			printf("Warning: The simulation is too far behind, a command was dropped\n");
+		return sent;
+	};
 
-		Vector_2d position = Vector_2d(Random::get(radius, SCREEN_WIDTH - radius), Random::get(radius, SCREEN_HEIGHT - radius));
-
-
-		PhysicsBall b(radius, color, position);
-		balls.push_back(b);
-	}*/
+	FramePacer framePacer(FPS);
+	if (VSYNC)
+		framePacer.setVsync(g_renderer, true);
+	uint64_t reportStartTime = SDL_GetPerformanceCounter();
+	//Reported with the pacing once a second, printing every frame would upset what it measures
+	uint64_t reportWorkTicks = 0;
+	int reportFrames = 0;
 
 
 
@@ -658,6 +1673,7 @@ int main(int argc, char** argv)
 		uint64_t startTime = SDL_GetPerformanceCounter();
 
 		//Event loop
+		bool mouseMoved = false;
 		while (SDL_PollEvent(&event))
 		{
 			if (SDL_QUIT == event.type)
@@ -667,10 +1683,117 @@ int main(int argc, char** argv)
 
 			if (SDL_KEYDOWN == event.type)
 			{
-				if (SDLK_SPACE == event.key.keysym.sym && spacebar.held == false)
+				if (SDLK_SPACE == event.key.keysym.sym && spacebarHeld == false)
+				{
+					spacebarHeld = true;
+					send(Command{ spawnCommand, mousePosition });
+				}
+				if (SDLK_DELETE == event.key.keysym.sym)
+				{
+					send(Command{ deleteCommand, mousePosition });
+				}
+				if (SDLK_b == event.key.keysym.sym)
 				{
-					spacebar.down = true;
-					spacebar.held = true;
+					send(Command{ bulkSpawnCommand });
+				}
+				if (SDLK_e == event.key.keysym.sym)
+				{
+					send(Command{ measureCommand });
+				}
+				if (SDLK_PERIOD == event.key.keysym.sym && settings.timeWarp < TIME_WARP_MAX)
+				{
+					settings.timeWarp *= 2;
+					printf("Time warp: x%d\n", settings.timeWarp);
+				}
+				if (SDLK_COMMA == event.key.keysym.sym && settings.timeWarp > 1)
+				{
+					settings.timeWarp /= 2;
+					printf("Time warp: x%d\n", settings.timeWarp);
+				}
+				if (SDLK_LEFTBRACKET == event.key.keysym.sym && settings.physicsRate > MIN_PHYSICS_RATE)
+				{
+					settings.physicsRate /= 2;
+					printf("Physics rate: %d Hz\n", settings.physicsRate);
+				}
+				if (SDLK_RIGHTBRACKET == event.key.keysym.sym && settings.physicsRate < MAX_PHYSICS_RATE)
+				{
+					settings.physicsRate *= 2;
+					printf("Physics rate: %d Hz\n", settings.physicsRate);
+				}
+				if (SDLK_v == event.key.keysym.sym)
+				{
+					framePacer.setVsync(g_renderer, !framePacer.getVsync());
+					printf("Vsync: %s\n", framePacer.getVsync() ? "on" : "off");
+				}
+				if (SDLK_i == event.key.keysym.sym)
+				{
+					settings.integrator = static_cast<integrators>((settings.integrator + 1) % max_integrators);
+					printf("Integrator: %s\n", integratorNames[settings.integrator]);
+				}
+				if (SDLK_LEFT == event.key.keysym.sym)
+				{
+					send(Command{ rewindCommand, mousePosition, false, -1 });
+				}
+				if (SDLK_RIGHT == event.key.keysym.sym)
+				{
+					send(Command{ rewindCommand, mousePosition, false, 1 });
+				}
+				if (SDLK_RETURN == event.key.keysym.sym)
+				{
+					send(Command{ carryOnCommand });
+				}
+				if (SDLK_d == event.key.keysym.sym)
+				{
+					settings.reduction = static_cast<reductionModes>((settings.reduction + 1) % max_reductionModes);
+					printf("Reductions: %s\n", reductionModeNames[settings.reduction]);
+				}
+				if (SDLK_p == event.key.keysym.sym)
+				{
+					settings.removalPolicy = static_cast<removalPolicies>((settings.removalPolicy + 1) % max_removalPolicies);
+					printf("Removal: %s\n", removalPolicyNames[settings.removalPolicy]);
+				}
+				if (SDLK_r == event.key.keysym.sym)
+				{
+					settings.reorder = !settings.reorder;
+					printf("Reordering along a space-filling curve: %s\n", settings.reorder ? "on" : "off");
+				}
+				if (SDLK_l == event.key.keysym.sym)
+				{
+					settings.pipelined = !settings.pipelined;
+					printf("Pipelined frames: %s\n", settings.pipelined ? "on, a frame of latency" : "off, every frame waits for its steps");
+				}
+				if (SDLK_h == event.key.keysym.sym)
+				{
+					settings.curve = hilbertCurve == settings.curve ? mortonCurve : hilbertCurve;
+					printf("Space-filling curve: %s\n", curveNames[settings.curve]);
+				}
+				if (SDLK_c == event.key.keysym.sym)
+				{
+					settings.costZones = !settings.costZones;
+					printf("Pieces of work: %s\n", settings.costZones ? "equal cost, from each ball's interactions last step" : "equal length");
+				}
+				if (SDLK_f == event.key.keysym.sym)
+				{
+					settings.forceLines = !settings.forceLines;
+					printf("Force lines: %s\n", settings.forceLines ? "on" : "off");
+				}
+				if (SDLK_g == event.key.keysym.sym)
+				{
+					batchedDrawing = !batchedDrawing;
+					printf("Drawing: %s\n", batchedDrawing ? "batches of triangles built in parallel" : "a call per line");
+				}
+				int scenario = event.key.keysym.sym - SDLK_1;
+				if (scenario >= 0 && scenario < max_scenarios)
+				{
+					Command command{ scenarioCommand };
+					command.index = scenario;
+					send(command);
+				}
+				if (SDLK_n == event.key.keysym.sym)
+				{
+					Command command{ scenarioEventCommand };
+					command.index = nextEvent;
+					send(command);
 				}
 			}
 
@@ -678,8 +1801,7 @@ int main(int argc, char** argv)
 			{
 				if (SDLK_SPACE == event.key.keysym.sym)
 				{
-					spacebar.up = true;
-					spacebar.held = false;
+					spacebarHeld = false;
 				}
 			}
 
@@ -689,24 +1811,25 @@ int main(int argc, char** argv)
 				SDL_GetMouseState(&x, &y);
 				mousePosition.x = x;
 				mousePosition.y = y;
+				mouseMoved = true;
 			}
 
 			if (SDL_MOUSEBUTTONDOWN == event.type)
 			{
-				if (SDL_BUTTON_LEFT == event.button.button)
+				//With the other button already down, do nothing
+				if (SDL_BUTTON_LEFT == event.button.button && !mouseButtons[right].held)
 				{
 					//printf("Left mouse button down.\n");
-					mouseButtons[left].down = true;
+					send(Command{ grabCommand, mousePosition, true });
 				}
-				if (SDL_BUTTON_RIGHT == event.button.button)
+				if (SDL_BUTTON_RIGHT == event.button.button && !mouseButtons[left].held)
 				{
 					//printf("Right mouse button down.\n");
-					mouseButtons[right].down = true;
+					send(Command{ grabCommand, mousePosition, false });
 				}
 				if (SDL_BUTTON_MIDDLE == event.button.button)
 				{
 					//printf("Middle mouse button down.\n");
-					mouseButtons[middle].down = true;
 				}
 			}
 			if ((SDL_GetMouseState(NULL, NULL) & SDL_BUTTON_LMASK))
@@ -731,19 +1854,18 @@ int main(int argc, char** argv)
 				if (SDL_BUTTON_LEFT == event.button.button)
 				{
 					//printf("Left mouse button up.\n");
-					mouseButtons[left].up = true;
 					mouseButtons[left].held = false;
+					send(Command{ releaseCommand });
 				}
 				if (SDL_BUTTON_RIGHT == event.button.button)
 				{
 					//printf("Right mouse button up.\n");
-					mouseButtons[right].up = true;
 					mouseButtons[right].held = false;
+					send(Command{ flingCommand, mousePosition });
 				}
 				if (SDL_BUTTON_MIDDLE == event.button.button)
 				{
 					//printf("Middle mouse button up.\n");
-					mouseButtons[middle].up = true;
 					mouseButtons[middle].held = false;
 				}
 			}
@@ -761,108 +1883,94 @@ int main(int argc, char** argv)
 			}
 		}
 
-		/*
-		if (mouseButtons[left].down)
-			printf("Left down######################.\n");
-		else
-			printf("Left not down.\n");
-		if (mouseButtons[left].held)
-			printf("Left held.\n");
-		else
-			printf("Left not held.\n");
-		if (mouseButtons[left].up)
-			printf("Left up^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^.\n");
-		else
-			printf("Left not up.\n");
-		printf("\n");
-		*/
-
 		//Frame of the program:
-		printf("FPS: %f\n", 1.0 / elapsedTime);
-		printf("Time per frame: %fms\n", deltaTime);
-		printf("REAL FPS: %f\n", 1.0 / realElapsedTime);
-		printf("REAL Time per frame: %fms\n\n", realDeltaTime);
-
-		if (spacebar.down)
-		{
-			double radius = 1.0;
-			SDL_Color color = SDL_Color(Random::get(0, 255), Random::get(0, 255), Random::get(0, 255), 255);
-			Vector_2d position = mousePosition;
-
-			PhysicsBall b(radius, color, position);
-			balls.push_back(b);
-		}
-		if (spacebar.held)
-		{
-			double radius = std::sqrt(distanceSquared(balls.back().getPosition(), mousePosition));
-			if (radius < 1.0)
-				radius = 1.0;
-
-			balls.back().setRadius(radius);
-		}
-		if (spacebar.up)
+		//Once per frame however many motion events there were
+		if (mouseMoved && mouseButtons[left].held)
+			send(Command{ dragCommand, mousePosition });
+		if (mouseMoved && spacebarHeld)
+			send(Command{ resizeCommand, mousePosition });
+		if (settings != sentSettings)
 		{
-			;
+			Command command{ settingsCommand };
+			command.previousSettings = sentSettings;
+			command.settings = settings;
+			if (send(command))
+				sentSettings = settings;
 		}
 
-		for (auto& ball : balls)
+		//Pipelined, whatever the simulation published last while it carries on with the next
+		//steps, drawn between its last two steps so it moves smoothly a step behind. Otherwise
+		//this frame's own steps, drawn as they are.
+		std::uint64_t frame = simulation.requestFrame();
+		if (!settings.pipelined)
+			simulation.waitForFrame(frame);
+		SimulationState& state = simulation.getLatestState();
+		double interpolation = 1.0;
+
+		//A scenario changed the time warp, the keys go on from there. Unless a key changed it
+		//and that didn't get through yet, then it's the key's change that counts.
+		if (state.timeWarp != publishedTimeWarp)
 		{
-			ball.calculateForces(balls);
+			publishedTimeWarp = state.timeWarp;
+			if (settings.timeWarp == sentSettings.timeWarp)
+			{
+				settings.timeWarp = state.timeWarp;
+				sentSettings.timeWarp = state.timeWarp;
+			}
 		}
-		for (auto& ball : balls)
+		if (settings.pipelined)
 		{
-			if (ball.checkCollisionWithPoint(mousePosition) && (mouseButtons[left].down || mouseButtons[right].down))
-				p_pickedUpBall = &ball;
-			ball.update(balls, mouseButtons, mousePosition, p_pickedUpBall, realElapsedTime);
+			double sincePublish = (SDL_GetPerformanceCounter() - state.publishTime) / (double)TICKS_PER_SECOND;
+			interpolation = std::min(sincePublish / state.stepLength, 1.0);
 		}
 
+		//From TIME_WARP_SKIP_PRESENT up nothing is drawn, the time goes to the simulation instead
+		bool present = state.timeWarp < TIME_WARP_SKIP_PRESENT;
 
-		SDL_SetRenderDrawColor(g_renderer, 0xff, 0xff, 0xff, 0xff);
-		SDL_RenderClear(g_renderer);
+		if (present)
+		{
+			SDL_SetRenderDrawColor(g_renderer, 0xff, 0xff, 0xff, 0xff);
+			SDL_RenderClear(g_renderer);
 
-		g_background.render(0, 0);
+			g_background.render(0, 0);
+			if (batchedDrawing)
+			{
+				std::size_t batchCount = prepareBalls(renderJobs, renderArenas.get(0), batches, state, mouseButtons, mousePosition, interpolation);
+				drawBatches(g_renderer, batches, batchCount);
+				renderArenas.reset();
+			}
+			else
+			{
+				showBalls(g_renderer, state, mouseButtons, mousePosition, interpolation);
+			}
 
-		for (auto& ball : balls)
-		{
-			ball.show(g_renderer, mouseButtons, mousePosition, p_pickedUpBall);
+			SDL_RenderPresent(g_renderer);
 		}
 
-		SDL_RenderPresent(g_renderer);
-
 
 
 		//End of the frame
-		mouseButtons[left].down = false;
-		mouseButtons[left].up = false;
-		mouseButtons[right].down = false;
-		mouseButtons[right].up = false;
-		mouseButtons[middle].down = false;
-		mouseButtons[middle].up = false;
-		spacebar.down = false;
-		spacebar.up = false;
+		reportWorkTicks += SDL_GetPerformanceCounter() - startTime;
+		++reportFrames;
 
-		uint64_t endTime = SDL_GetPerformanceCounter();
-		deltaTime = ((endTime - startTime) * 1000 / (double)TICKS_PER_SECOND);
-		elapsedTime = deltaTime / 1000.0;
-
-		int driftTime = (1000 / FPS - deltaTime); //time per frame (in ms) - deltaTime
+		framePacer.waitForNextFrame();
 
-		if (driftTime > 0)
-		{
-			SDL_Delay(driftTime);
-		}
-		else if (driftTime < 0)
+		uint64_t realEndTime = SDL_GetPerformanceCounter();
+		if ((realEndTime - reportStartTime) / (double)TICKS_PER_SECOND >= 1.0)
 		{
-			printf("Warning: program running too slow.\n");
+			double meanFrameTime = framePacer.getMeanFrameTime();
+			printf("Frame pacing: %f FPS, mean %fms of which %fms work, jitter %fms, worst %fms, %d late frames, sleep margin %fms\n",
+				meanFrameTime > 0.0 ? 1.0 / meanFrameTime : 0.0, meanFrameTime * 1000.0, reportWorkTicks * 1000.0 / TICKS_PER_SECOND / reportFrames,
+				framePacer.getJitter() * 1000.0, framePacer.getWorstFrameTime() * 1000.0, framePacer.getLateFrames(), framePacer.getSleepMargin() * 1000.0);
+			framePacer.resetStatistics();
+			reportWorkTicks = 0;
+			reportFrames = 0;
+			reportStartTime = realEndTime;
 		}
-
-		uint64_t realEndTime = SDL_GetPerformanceCounter();
-
-		realDeltaTime = ((realEndTime - startTime) * 1000 / (double)TICKS_PER_SECOND);
-		realElapsedTime = realDeltaTime / 1000.0;
 	}
 
 
+	simulation.stop();
 	close();
 	return 0;
 }
\ No newline at end of file